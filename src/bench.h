@@ -0,0 +1,23 @@
+#ifndef TUNA_BENCH_H
+#define TUNA_BENCH_H
+
+#include <span>
+
+#include "cfg.h"
+#include "common.h"
+
+namespace tuna::bench {
+
+// FENs of the positions searched by run
+std::span<const char *const> positions();
+
+// Searches a fixed set of positions to the given depth and prints the
+// total nodes, time and nps. With one thread, the node count only changes
+// when the search does. With stats, the search statistics of each depth
+// are summed over the positions and printed too. Returns the node count
+u64 run(Ply depth = cfg::BENCH_DEPTH, u64 hash_mb = cfg::BENCH_HASH_MB,
+        i32 threads = 1, bool stats = false);
+
+}  // namespace tuna::bench
+
+#endif
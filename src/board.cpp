@@ -14,6 +14,7 @@
 #include "hash.h"
 #include "lookup.h"
 #include "movegen.h"
+#include "perf.h"
 
 namespace tuna::board {
 
@@ -144,18 +145,25 @@ Bitboard Board::evasion_mask() const {
 }
 
 // Test if TT move is valid
-// Assumes the move is one that can be generated by MoveGenerator
+// Assumes the move is one that can be generated by MoveGenerator.
+// Special moves are only accepted if they are also legal
 bool Board::is_pseudo_legal(Move move) const {
     update_moveinfo(move);
-    if (is_ep() || is_promotion() || is_castle()) {
-        return movegen::is_legal_move(*this, move);
-    }
     auto from_bb = bb::from_sq(mi_.from);
     auto to_bb = bb::from_sq(mi_.to);
     if ((color_bb_[turn_] & from_bb) == bb::Empty ||
         (color_bb_[turn_] & to_bb) != bb::Empty) {
         return false;
     }
+    if (is_promotion()) {
+        return is_pseudo_legal_promotion();
+    }
+    if (is_castle()) {
+        return is_pseudo_legal_castle();
+    }
+    if (is_ep()) {
+        return is_pseudo_legal_ep();
+    }
     if (!is_pseudo_legal_attack()) {
         return false;
     }
@@ -183,6 +191,91 @@ bool Board::is_legal(Move move) const {
     return true;
 }
 
+// The king moving to `to` would not be in check. The king is taken off the
+// board first, so it cannot block a slider attacking its own new square.
+bool Board::is_safe_king_to(Square to) const {
+    auto occ = all() ^ bb(piece::King, turn_);
+    return (attackers_to(to, occ) & color_bb_[!turn_]) == bb::Empty;
+}
+
+// Castling rights, an empty path between king and rook, and no check on
+// any square the king stands on or crosses
+bool Board::can_castle(Castling c) const {
+    auto &ci = CASTLING_INFO[c];
+    if (!castling_possible(c) || in_check()) {
+        return false;
+    }
+    auto ib = lookup::in_between(ci.king_from, ci.rook_from);
+    if ((ib & all()) != bb::Empty) {
+        return false;
+    }
+    auto ib_sq = bb::top_sq(lookup::in_between(ci.king_from, ci.king_to));
+    return !is_attacked(ib_sq, color_bb_[!turn_]) &&
+           is_safe_king_to(ci.king_to);
+}
+
+// Swap algorithm. Captures alternate on the target square, each side using
+// its least valuable attacker. Sliders behind a capturing piece join in
+// once it leaves the square. Pins are ignored. Castling, ep and promotions
+// are scored as an even exchange.
+bool Board::see(Move move, Score threshold) const {
+    perf::record(perf::SeeCalls);
+    auto from = move::from(move);
+    auto to = move::to(move);
+    auto from_pc = piece_on_[from];
+    auto to_pc = piece_on_[to];
+    auto is_special = move::promotion(move) != piece::None ||
+                      (from_pc == piece::King && abs(to - from) == 2) ||
+                      (from_pc == piece::Pawn && to_pc == piece::None &&
+                       square::file(from) != square::file(to));
+    if (is_special) {
+        return 0 >= threshold;
+    }
+    // What we gain if the exchange stops now, from the side to move's view
+    i32 swap = (to_pc == piece::None ? 0 : SEE_VALUE[to_pc]) - threshold;
+    if (swap < 0) {
+        return false;
+    }
+    // Even losing the moved piece keeps us above the threshold
+    swap = SEE_VALUE[from_pc] - swap;
+    if (swap <= 0) {
+        return true;
+    }
+    auto occ = all() ^ bb::from_sq(from) ^ bb::from_sq(to);
+    auto attackers = attackers_to(to, occ) & occ;
+    auto sd = turn_;
+    auto res = 1;
+    while (true) {
+        sd = !sd;
+        attackers &= occ;
+        auto sd_attackers = attackers & color_bb_[sd];
+        if (sd_attackers == bb::Empty) {
+            break;
+        }
+        res ^= 1;
+        Bitboard from_bb;
+        auto pc = least_valuable(sd_attackers, from_bb);
+        if (pc == piece::King) {
+            // The king can only capture if the square is no longer defended
+            return (attackers & color_bb_[!sd]) != bb::Empty ? res ^ 1 : res;
+        }
+        swap = SEE_VALUE[pc] - swap;
+        if (swap < res) {
+            break;
+        }
+        occ ^= from_bb;
+        // X-rays
+        if (pc == piece::Pawn || pc == piece::Bishop || pc == piece::Queen) {
+            attackers |=
+                lookup::attacks(piece::Bishop, to, occ) & bishop_likes();
+        }
+        if (pc == piece::Rook || pc == piece::Queen) {
+            attackers |= lookup::attacks(piece::Rook, to, occ) & rook_likes();
+        }
+    }
+    return res;
+}
+
 bool Board::in_check() const {
     return checkers_ != bb::Empty;
 }
@@ -219,10 +312,39 @@ Hash Board::hash() const {
     return hash_;
 }
 
+// Cheap estimate of the hash after making move (or a null move), used to
+// prefetch the TT. Ignores castling rights and promotions, which make_move
+// does account for.
+Hash Board::hash_after(Move move) const {
+    auto h = hash_ ^ hash::side;
+    if (ep_ != file::None) {
+        h ^= hash::ep[ep_];
+    }
+    if (move == move::Null) {
+        return h;
+    }
+    auto from = move::from(move);
+    auto to = move::to(move);
+    auto pc = piece_on_[from];
+    auto captured = piece_on_[to];
+    h ^= hash::piece[turn_][pc][from] ^ hash::piece[turn_][pc][to];
+    if (captured != piece::None) {
+        h ^= hash::piece[!turn_][captured][to];
+    }
+    if (pc == piece::Pawn && abs(to - from) == 16) {
+        h ^= hash::ep[square::file(from)];
+    }
+    return h;
+}
+
 i32 Board::checkers_count() const {
     return bb::popcnt(checkers_);
 }
 
+Bitboard Board::pinned() const {
+    return pinned_;
+}
+
 Score Board::mg_material() const {
     return mg_material_;
 }
@@ -425,25 +547,30 @@ Bitboard Board::pawn_attacks_from(Square sq, Color sd) const {
                                         : sh(sq_bb, NW) | sh(sq_bb, NE));
 }
 
-Bitboard Board::attacks_from(Piece pc, Square sq) const {
+Bitboard Board::attacks_from(Piece pc, Square sq, Bitboard occ) const {
     if (pc == piece::Pawn) {
         return pawn_attacks_from(sq, color::White) |
                pawn_attacks_from(sq, color::Black);
     } else {
-        return lookup::attacks(pc, sq, all());
+        return lookup::attacks(pc, sq, occ);
     }
 }
 
-Bitboard Board::attackers_to(Square sq) const {
+// Sliders see through squares missing from occ
+Bitboard Board::attackers_to(Square sq, Bitboard occ) const {
     auto all_atkrs = bb::Empty;
 #pragma GCC unroll 6
     for (Piece pc = piece::Pawn; pc <= piece::King; pc++) {
-        all_atkrs |= attacks_from(pc, sq) & piece_bb_[pc];
+        all_atkrs |= attacks_from(pc, sq, occ) & piece_bb_[pc];
     }
     all_atkrs &= all();
     return all_atkrs;
 }
 
+Bitboard Board::attackers_to(Square sq) const {
+    return attackers_to(sq, all());
+}
+
 Bitboard Board::bishop_likes() const {
     return piece_bb_[piece::Bishop] | piece_bb_[piece::Queen];
 }
@@ -452,6 +579,18 @@ Bitboard Board::rook_likes() const {
     return piece_bb_[piece::Rook] | piece_bb_[piece::Queen];
 }
 
+Piece Board::least_valuable(Bitboard attackers, Bitboard &from_bb) const {
+    for (Piece pc = piece::Pawn; pc < piece::King; pc++) {
+        auto pc_atkrs = attackers & piece_bb_[pc];
+        if (pc_atkrs != bb::Empty) {
+            from_bb = bb::from_sq(bb::top_sq(pc_atkrs));
+            return pc;
+        }
+    }
+    from_bb = attackers & piece_bb_[piece::King];
+    return piece::King;
+}
+
 void Board::update_checkers() {
     checkers_ = attackers_to(king_sq(turn_)) & color_bb_[!turn_];
 }
@@ -594,6 +733,56 @@ bool Board::is_pseudo_legal_attack() const {
     return true;
 }
 
+bool Board::is_pseudo_legal_promotion() const {
+    auto from_bb = bb::from_sq(mi_.from);
+    auto to_bb = bb::from_sq(mi_.to);
+    if (mi_.from_pc != piece::Pawn || (rank_8() & to_bb) == bb::Empty ||
+        mi_.promotion < piece::Knight || mi_.promotion > piece::Queen) {
+        return false;
+    }
+    auto tos =
+        single_pushes(from_bb) | (pawn_attacks(from_bb) & color_bb_[!turn_]);
+    if ((tos & to_bb) == bb::Empty) {
+        return false;
+    }
+    return checkers_ == bb::Empty || is_pseudo_legal_evasion();
+}
+
+// Fully legal, as castling is checked in one go
+bool Board::is_pseudo_legal_castle() const {
+    auto first = turn_ == color::White ? castling::WhiteKingside
+                                       : castling::BlackKingside;
+    for (Castling c = first; c < first + 2; c++) {
+        auto &ci = CASTLING_INFO[c];
+        if (mi_.from == ci.king_from && mi_.to == ci.king_to) {
+            return can_castle(c);
+        }
+    }
+    return false;
+}
+
+// Pins and the rank discovered check are handled later in is_legal
+bool Board::is_pseudo_legal_ep() const {
+    if (ep_ == file::None) {
+        return false;
+    }
+    auto ep_sq = square::init(rank::rel(rank::_6, turn_), ep_);
+    auto to_bb = bb::from_sq(mi_.to);
+    if (mi_.to != ep_sq ||
+        (pawn_attacks(bb::from_sq(mi_.from)) & to_bb) == bb::Empty) {
+        return false;
+    }
+    if (checkers_ == bb::Empty) {
+        return true;
+    }
+    if (bb::popcnt(checkers_) >= 2) {
+        return false;
+    }
+    // Either blocks the check or captures the checking pawn
+    auto captured_bb = bb::from_sq(mi_.to ^ 8);
+    return ((to_bb | captured_bb) & evasion_mask()) != bb::Empty;
+}
+
 bool Board::is_pseudo_legal_evasion() const {
     // We will handle king evasions later in is_legal
     if (mi_.from_pc == piece::King) {
@@ -70,16 +70,23 @@ public:
 
     bool is_pseudo_legal(Move move) const;
     bool is_legal(Move move) const;
+    bool is_safe_king_to(Square to) const;
+    bool can_castle(Castling c) const;
     bool in_check() const;
     bool is_capture(Move move) const;
     bool is_draw() const;
+    // Static exchange evaluation. Whether the exchange started by move on
+    // its target square gains at least threshold for the side to move
+    bool see(Move move, Score threshold) const;
 
     Bitboard color_bb(Color sd) const;
     Piece piece_on(Square sq) const;
     Color turn() const;
     File ep() const;
     Hash hash() const;
+    Hash hash_after(Move move) const;
     i32 checkers_count() const;
+    Bitboard pinned() const;
     Score mg_material() const;  // material always from white's perspective
     Score eg_material() const;  // material always from white's perspective
     i32 game_phase() const;
@@ -119,12 +126,15 @@ private:
     void flip_turn();
 
     Bitboard pawn_attacks_from(Square sq, Color sd) const;
-    Bitboard attacks_from(Piece pc, Square sq) const;
+    Bitboard attacks_from(Piece pc, Square sq, Bitboard occ) const;
+    Bitboard attackers_to(Square sq, Bitboard occ) const;
     Bitboard attackers_to(Square sq) const;
 
     Bitboard bishop_likes() const;
     Bitboard rook_likes() const;
 
+    Piece least_valuable(Bitboard attackers, Bitboard &from_bb) const;
+
     void update_checkers();
     void update_pinned();
     void update_infos();
@@ -153,6 +163,9 @@ private:
     Bitboard pawn_attacks(Bitboard pawns) const;
 
     bool is_pseudo_legal_attack() const;
+    bool is_pseudo_legal_promotion() const;
+    bool is_pseudo_legal_castle() const;
+    bool is_pseudo_legal_ep() const;
     bool is_pseudo_legal_evasion() const;
 
     bool is_attacked(Square sq, Bitboard attackers_mask) const;
@@ -209,6 +222,11 @@ const auto CASTLING_INFO = std::array<CastlingInfo, 4>{{
     {square::E8, square::C8, square::A8, square::D8},
 }};
 
+// Roughly the average PST value of each piece. The king can never be
+// captured, so its value does not matter
+const auto SEE_VALUE =
+    std::array<Score, piece::size>{130, 360, 390, 620, 1200, 0};
+
 }  // namespace tuna::board
 
 #endif
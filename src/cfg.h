@@ -9,11 +9,21 @@ namespace tuna::cfg {
 const auto UCI_NAME = std::format("tuna {}", TUNA_VERSION);
 const auto UCI_AUTHOR = "Bill Chow";
 const auto DEVEL = UCI_NAME.find('-') != std::string::npos;
-const auto MOVE_VEC_RESERVE_CAP = 32;
+const auto MOVE_LIST_CAP = 256;
+const auto PERFT_HASH_MB = 64;  // Default size of the perft table
+const auto BENCH_DEPTH = 10;
+const auto BENCH_HASH_MB = 16;
 const auto KILLERS_COUNT = 2;
 const auto SEARCH_POLL_NODE_FREQ = 1'024;
 const auto ASP_WINDOW_SIZE = 10;
 const auto UCI_LATENCY_MS = 5;
+const auto QSEARCH_TT = true;  // Probe and store the TT in qsearch
+// Count perf::Counter events. Compiled out of release builds
+#ifdef NDEBUG
+const auto PERF_COUNTERS = false;
+#else
+const auto PERF_COUNTERS = true;
+#endif
 
 }  // namespace tuna::cfg
 
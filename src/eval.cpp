@@ -1,6 +1,7 @@
 #include "eval.h"
 
 #include "common.h"
+#include "perf.h"
 
 namespace tuna::eval {
 
@@ -151,6 +152,7 @@ i32 piece_phase(Piece pc) {
 }
 
 Score evaluate(Board &board) {
+    perf::record(perf::Evaluations);
     auto mg_phase = std::min(board.game_phase(), 24);
     auto eg_phase = 24 - mg_phase;
     auto mg_material = board.mg_material();
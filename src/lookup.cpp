@@ -32,6 +32,7 @@ const auto ROOK_ATK_DIRS = std::array<Direction, 4>{
 };
 
 auto IN_BETWEEN = std::array<std::array<Bitboard, 64>, 64>();
+auto LINE = std::array<std::array<Bitboard, 64>, 64>();
 // No auto for successful compilation in GitHub Actions
 std::array<Bitboard, 64> KNIGHT_ATTACKS;
 std::array<Bitboard, 64> KING_ATTACKS;
@@ -129,6 +130,25 @@ Bitboard attacks_bb(Piece pc, Square sq, Bitboard occ) {
     return attacks;
 }
 
+// Needs empty-board slider attacks, so it cannot reuse IN_BETWEEN
+void init_line() {
+    for (Square i = square::A1; i <= square::H8; i++) {
+        for (Square j = square::A1; j <= square::H8; j++) {
+            if (i == j) {
+                continue;
+            }
+            for (auto pc : {piece::Bishop, piece::Rook}) {
+                auto i_atks = attacks_bb(pc, i, bb::Empty);
+                if (i_atks & bb::from_sq(j)) {
+                    auto j_atks = attacks_bb(pc, j, bb::Empty);
+                    LINE[i][j] = i_atks & j_atks | bb::from_sq(i) |
+                                 bb::from_sq(j);
+                }
+            }
+        }
+    }
+}
+
 void init_pext_attacks(Piece pc, std::array<u32, 64> &offset,
                        std::array<Bitboard, 64> &mask) {
     for (Square i = square::A1; i <= square::H8; i++) {
@@ -160,6 +180,7 @@ void init_attacks() {
 
 void init() {
     init_in_between();
+    init_line();
     init_attacks();
 }
 
@@ -167,6 +188,10 @@ Bitboard in_between(Square from, Square to) {
     return IN_BETWEEN[from][to];
 }
 
+Bitboard line(Square s0, Square s1) {
+    return LINE[s0][s1];
+}
+
 u64 pext(Bitboard src, Bitboard mask) {
 #if defined(__BMI2__)
     return _pext_u64(src, mask);
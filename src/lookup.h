@@ -15,6 +15,10 @@ extern std::array<Bitboard, 64> KING_ATTACKS;
 
 Bitboard in_between(Square from, Square to);
 
+// The whole rank, file or diagonal through both squares. Empty if they
+// are not aligned
+Bitboard line(Square s0, Square s1);
+
 Bitboard bishop_attacks(Bitboard occ, Square sq);
 
 Bitboard rook_attacks(Bitboard occ, Square sq);
@@ -12,7 +12,10 @@ void init() {
     search::init();
 }
 
-i32 main() {
+i32 main(i32 argc, char **argv) {
     init();
+    if (argc > 1) {
+        return uci::run_args(argc, argv);
+    }
     return uci::run_loop();
 }
@@ -2,8 +2,13 @@
 
 #include <algorithm>
 #include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
 #include <string>
+#include <thread>
 #include <unordered_set>
+#include <vector>
 
 #include "bb.h"
 #include "board.h"
@@ -11,6 +16,7 @@
 #include "common.h"
 #include "logging.h"
 #include "lookup.h"
+#include "perf.h"
 
 namespace tuna::movegen {
 
@@ -23,39 +29,128 @@ const auto KING_DIRS = std::array{
     dir::N, dir::NE, dir::E, dir::SE, dir::S, dir::SW, dir::W, dir::NW,
 };
 
+void MoveList::push_back(Move move) {
+    assert(size_ < cfg::MOVE_LIST_CAP);
+    moves_[size_++] = move;
+}
+
+void MoveList::clear() {
+    size_ = 0;
+}
+
+void MoveList::resize(i32 size) {
+    assert(size <= size_);
+    size_ = size;
+}
+
+i32 MoveList::size() const {
+    return size_;
+}
+
+bool MoveList::empty() const {
+    return size_ == 0;
+}
+
+Move MoveList::operator[](i32 i) const {
+    return moves_[i];
+}
+
+Move *MoveList::begin() {
+    return moves_.data();
+}
+
+Move *MoveList::end() {
+    return moves_.data() + size_;
+}
+
+const Move *MoveList::begin() const {
+    return moves_.data();
+}
+
+const Move *MoveList::end() const {
+    return moves_.data() + size_;
+}
+
 MoveGenerator::MoveGenerator(const Board &board) : board_(board) {}
 
-// Pseudo-legal moves. We do not check for legal moves here.
-// It is up to the caller to decide when to call is_legal.
+// Legal moves only. Pinned pieces stay on their pin ray and the king only
+// moves to safe squares, so callers never need Board::is_legal.
 void MoveGenerator::generate(Type type) {
-    update_boardinfo();
     moves_.clear();
-    moves_.reserve(cfg::MOVE_VEC_RESERVE_CAP);
-    auto to_mask = get_to_mask(type);
+    generate_moves(type);
+}
+
+// Appends to the moves already generated
+void MoveGenerator::generate_moves(Type type) {
+    perf::record(perf::MoveGenerations);
+    auto white = board_.turn() == color::White;
+    switch (type) {
+    case Evasions:
+        return white ? generate_moves<color::White, Evasions>()
+                     : generate_moves<color::Black, Evasions>();
+    case Captures:
+        return white ? generate_moves<color::White, Captures>()
+                     : generate_moves<color::Black, Captures>();
+    case Quiets:
+        return white ? generate_moves<color::White, Quiets>()
+                     : generate_moves<color::Black, Quiets>();
+    default:
+        unreachable();
+    }
+}
+
+// The side to move and the move type are template parameters, so that
+// pawn directions, rank masks and the promotion rules of each type are
+// compile-time constants
+template<Color Us, Type T>
+void MoveGenerator::generate_moves() {
+    update_boardinfo();
+    auto to_mask = get_to_mask<Us, T>();
     if (board_.checkers_count() >= 2) {
-        generate_piece(piece::King, bi_.king_bb, to_mask);
+        generate_piece(piece::King, bi_.king_bb, king_to_mask(to_mask));
         return;
     }
-    generate_pawn(type, to_mask);
+    generate_pawn<Us, T>(to_mask);
     for (Piece pc = piece::Knight; pc <= piece::Queen; pc++) {
-        auto pc_bb = board_.bb(pc, board_.turn());
+        auto pc_bb = board_.bb(pc, Us);
         generate_piece(pc, pc_bb, to_mask);
     }
-    if (type == Evasions) {
-        to_mask = ~board_.color_bb(board_.turn());
+    if constexpr (T == Evasions) {
+        to_mask = ~board_.color_bb(Us);
+    }
+    generate_piece(piece::King, bi_.king_bb, king_to_mask(to_mask));
+    generate_castlings<Us, T>();
+}
+
+PerftTable::PerftTable(u64 mb)
+    : entries_(std::bit_floor(
+          std::max<u64>(mb * 1024 * 1024 / sizeof(Entry), 1))) {}
+
+bool PerftTable::probe(Hash hash, i32 depth, u64 &nodes) const {
+    auto &e = entries_[hash & (entries_.size() - 1)];
+    auto data = e.data.load(std::memory_order_relaxed);
+    auto key = e.key.load(std::memory_order_relaxed);
+    if ((key ^ data) != hash || (data & 0xff) != u64(depth)) {
+        return false;
     }
-    generate_piece(piece::King, bi_.king_bb, to_mask);
-    generate_castlings(type);
+    nodes = data >> 8;
+    return true;
+}
+
+void PerftTable::store(Hash hash, i32 depth, u64 nodes) {
+    auto &e = entries_[hash & (entries_.size() - 1)];
+    auto data = nodes << 8 | u64(depth);
+    e.key.store(hash ^ data, std::memory_order_relaxed);
+    e.data.store(data, std::memory_order_relaxed);
 }
 
-const std::vector<Move> &MoveGenerator::moves() const {
+const MoveList &MoveGenerator::moves() const {
     return moves_;
 }
 
 bool MoveGenerator::has_legal_move(const Board &board) {
     MoveGenerator gen(board);
     gen.generate_all();
-    filter_legal(gen);
     return !gen.moves().empty();
 }
 
@@ -68,23 +163,34 @@ bool MoveGenerator::is_legal_move(const Board &board, Move move) {
     return std::find(ms.begin(), ms.end(), move) != ms.end();
 }
 
-u64 MoveGenerator::perft(Board &board, i32 depth, bool is_root) {
+u64 MoveGenerator::perft(Board &board, i32 depth, bool is_root,
+                         PerftTable *table) {
     if (depth == 0) {
         return 1;
     }
     u64 ttl = 0;
+    // Depth 1 is cheaper to count than to probe
+    if (table != nullptr && !is_root && depth > 1 &&
+        table->probe(board.hash(), depth, ttl)) {
+        return ttl;
+    }
     MoveGenerator gen(board);
     gen.generate_all();
-    filter_legal(gen);
+    if (depth == 1 && !is_root) {
+        return gen.moves().size();
+    }
     for (auto m : gen.moves()) {
         board.make_move(m);
-        u64 sub_ttl = perft(board, depth - 1, false);
+        u64 sub_ttl = perft(board, depth - 1, false, table);
         ttl += sub_ttl;
         board.unmake_move();
         if (is_root) {
             io::println("{}: {}", move::to_str(m), sub_ttl);
         }
     }
+    if (table != nullptr && depth > 1) {
+        table->store(board.hash(), depth, ttl);
+    }
     if (is_root) {
         io::println("");
         io::println("Nodes searched: {}\n", ttl);
@@ -92,6 +198,44 @@ u64 MoveGenerator::perft(Board &board, i32 depth, bool is_root) {
     return ttl;
 }
 
+u64 MoveGenerator::perft_parallel(const Board &board, i32 depth, i32 threads,
+                                  PerftTable *table) {
+    auto start = std::chrono::steady_clock::now();
+    MoveGenerator gen(board);
+    gen.generate_all();
+    auto &moves = gen.moves();
+    std::vector<u64> sub_ttls(moves.size());
+    std::atomic<i32> next = 0;
+    auto work = [&] {
+        auto b = board;
+        for (auto i = next++; i < moves.size(); i = next++) {
+            b.make_move(moves[i]);
+            sub_ttls[i] = perft(b, depth - 1, false, table);
+            b.unmake_move();
+        }
+    };
+    std::vector<std::thread> workers;
+    for (auto i = 0; i < threads; i++) {
+        workers.emplace_back(work);
+    }
+    for (auto &worker : workers) {
+        worker.join();
+    }
+    auto millis = std::chrono::duration_cast<std::chrono::milliseconds>(
+                      std::chrono::steady_clock::now() - start)
+                      .count();
+    u64 ttl = 0;
+    for (auto i = 0; i < moves.size(); i++) {
+        io::println("{}: {}", move::to_str(moves[i]), sub_ttls[i]);
+        ttl += sub_ttls[i];
+    }
+    io::println("");
+    io::println("Nodes searched: {}", ttl);
+    io::println("Time: {} ms, {} nps\n", millis,
+                ttl * 1000 / std::max<u64>(millis, 1));
+    return ttl;
+}
+
 // Test function for Board::is_pseudo_legal
 u64 MoveGenerator::perft_pseudo_legal(Board &board, i32 depth, bool is_root) {
     if (depth == 0) {
@@ -101,7 +245,6 @@ u64 MoveGenerator::perft_pseudo_legal(Board &board, i32 depth, bool is_root) {
     MoveGenerator gen(board);
     gen.generate_all();
     check_pseudo_legal(gen);
-    filter_legal(gen);
     for (auto m : gen.moves()) {
         board.make_move(m);
         u64 sub_ttl = perft_pseudo_legal(board, depth - 1, false);
@@ -121,22 +264,21 @@ u64 MoveGenerator::perft_pseudo_legal(Board &board, i32 depth, bool is_root) {
 void MoveGenerator::update_boardinfo() {
     bi_.king_bb = board_.bb(piece::King, board_.turn());
     bi_.king_sq = board_.king_sq(board_.turn());
+    bi_.pinned = board_.pinned();
 }
 
-Bitboard MoveGenerator::get_to_mask(Type type) const {
-    switch (type) {
-    case Evasions:
+template<Color Us, Type T>
+Bitboard MoveGenerator::get_to_mask() const {
+    if constexpr (T == Evasions) {
         if (board_.checkers_count() >= 2) {
-            return ~board_.color_bb(board_.turn());
+            return ~board_.color_bb(Us);
         } else {
             return board_.evasion_mask();
         }
-    case Captures:
-        return board_.color_bb(!board_.turn());
-    case Quiets:
+    } else if constexpr (T == Captures) {
+        return board_.color_bb(!Us);
+    } else {
         return ~board_.all();
-    default:
-        unreachable();
     }
 }
 
@@ -144,43 +286,90 @@ void MoveGenerator::add(Square from, Square to, Piece promotion) {
     moves_.push_back(move::init(from, to, promotion));
 }
 
-Bitboard MoveGenerator::rank_8() const {
-    return board_.turn() == color::White ? bb::RANK_8 : bb::RANK_1;
+// Pawns are generated a whole bitboard at a time, so pins are checked per
+// move. En passant can also expose the king along the rank of the two
+// pawns, which is rare enough to leave to Board::is_legal.
+void MoveGenerator::add_pawn(Square from, Square to, Piece promotion) {
+    if ((pin_mask(from) & bb::from_sq(to)) == bb::Empty) {
+        return;
+    }
+    auto move = move::init(from, to, promotion);
+    if (board_.piece_on(to) == piece::None &&
+        square::file(from) != square::file(to) && !board_.is_legal(move)) {
+        return;
+    }
+    moves_.push_back(move);
+}
+
+// A pinned piece may only move along the line through it and its king
+Bitboard MoveGenerator::pin_mask(Square from) const {
+    if ((bi_.pinned & bb::from_sq(from)) == bb::Empty) {
+        return ~bb::Empty;
+    }
+    return lookup::line(bi_.king_sq, from);
+}
+
+Bitboard MoveGenerator::king_to_mask(Bitboard to_mask) const {
+    auto tos = lookup::attacks(piece::King, bi_.king_sq) & to_mask;
+    auto mask = bb::Empty;
+    while (tos != bb::Empty) {
+        auto to = bb::next_sq(tos);
+        if (board_.is_safe_king_to(to)) {
+            mask |= bb::from_sq(to);
+        }
+    }
+    return mask;
+}
+
+template<Color Us>
+constexpr Bitboard rank_2() {
+    return Us == color::White ? bb::RANK_2 : bb::RANK_7;
+}
+
+template<Color Us>
+constexpr Bitboard rank_8() {
+    return Us == color::White ? bb::RANK_8 : bb::RANK_1;
 }
 
+template<Color Us>
 Bitboard MoveGenerator::single_pushes() const {
-    return board_.single_pushes(board_.bb(piece::Pawn, board_.turn()));
+    auto pawns = board_.bb(piece::Pawn, Us);
+    return bb::shift(pawns, dir::N, Us) & ~board_.all();
 }
 
+template<Color Us>
 void MoveGenerator::generate_single_pushes(Bitboard to_mask) {
-    auto tos = single_pushes() & ~rank_8() & to_mask;
+    auto tos = single_pushes<Us>() & ~rank_8<Us>() & to_mask;
     while (tos != bb::Empty) {
         auto to = bb::next_sq(tos);
-        add(square::sub(to, dir::N, board_.turn()), to);
+        add_pawn(square::sub(to, dir::N, Us), to);
     }
 }
 
+template<Color Us>
 Bitboard MoveGenerator::double_pushes() const {
-    return board_.double_pushes(board_.bb(piece::Pawn, board_.turn()));
+    auto pawns = board_.bb(piece::Pawn, Us) & rank_2<Us>();
+    auto tos = bb::shift(pawns, dir::N, Us) & ~board_.all();
+    return bb::shift(tos, dir::N, Us) & ~board_.all();
 }
 
+template<Color Us>
 void MoveGenerator::generate_double_pushes(Bitboard to_mask) {
-    auto tos = double_pushes() & to_mask;
+    auto tos = double_pushes<Us>() & to_mask;
     while (tos != bb::Empty) {
         auto to = bb::next_sq(tos);
-        add(square::sub(to, dir::NN, board_.turn()), to);
+        add_pawn(square::sub(to, dir::NN, Us), to);
     }
 }
 
-Bitboard MoveGenerator::pawn_capture_to_mask(Type type,
-                                             Bitboard to_mask) const {
-    assert(type != Quiets);
-    auto theirs = board_.color_bb(!board_.turn());
+template<Color Us>
+Bitboard MoveGenerator::pawn_capture_to_mask(Bitboard to_mask) const {
+    auto theirs = board_.color_bb(!Us);
     auto mask = theirs & to_mask;
     // Do not mask away ep target square if it exists
     // We will check all ep moves later in is_legal()
     if (board_.ep() != file::None) {
-        auto ep_rk = rank::rel(rank::_6, board_.turn());
+        auto ep_rk = rank::rel(rank::_6, Us);
         auto ep_fl = board_.ep();
         auto ep_sq = square::init(ep_rk, ep_fl);
         mask ^= bb::from_sq(ep_sq);
@@ -188,98 +377,106 @@ Bitboard MoveGenerator::pawn_capture_to_mask(Type type,
     return mask;
 }
 
+template<Color Us>
 Bitboard MoveGenerator::quiet_promotion_tos(Bitboard to_mask) const {
-    return single_pushes() & rank_8() & to_mask;
+    return single_pushes<Us>() & rank_8<Us>() & to_mask;
 }
 
-void MoveGenerator::generate_quiet_queen_promotion(Type type,
-                                                   Bitboard to_mask) {
+template<Color Us, Type T>
+void MoveGenerator::generate_quiet_queen_promotion(Bitboard to_mask) {
     // Do not generate queen promotion in Quiets.
     // Avoids duplicate moves in Captures,
-    if (type == Quiets) {
+    if constexpr (T == Quiets) {
         return;
     }
     // We want to generate technically quiet queen promotions in captures
     // In order to do so, we have to use a Quiets to_mask
     // Evasions to_mask is left untouched
-    if (type == Captures) {
-        to_mask = get_to_mask(Quiets);
+    if constexpr (T == Captures) {
+        to_mask = get_to_mask<Us, Quiets>();
     }
-    auto tos = quiet_promotion_tos(to_mask);
+    auto tos = quiet_promotion_tos<Us>(to_mask);
     while (tos != bb::Empty) {
         auto to = bb::next_sq(tos);
-        add(square::sub(to, dir::N, board_.turn()), to, piece::Queen);
+        add_pawn(square::sub(to, dir::N, Us), to, piece::Queen);
     }
 }
 
-void MoveGenerator::generate_quiet_underpromotions(Type type,
-                                                   Bitboard to_mask) {
-    if (type == Captures) {
+template<Color Us, Type T>
+void MoveGenerator::generate_quiet_underpromotions(Bitboard to_mask) {
+    if constexpr (T == Captures) {
         return;
     }
-    auto tos = quiet_promotion_tos(to_mask);
+    auto tos = quiet_promotion_tos<Us>(to_mask);
     while (tos != bb::Empty) {
         auto to = bb::next_sq(tos);
         for (Piece pc = piece::Rook; pc >= piece::Knight; pc--) {
-            add(square::sub(to, dir::N, board_.turn()), to, pc);
+            add_pawn(square::sub(to, dir::N, Us), to, pc);
         }
     }
 }
 
-void MoveGenerator::generate_quiet_promotions(Type type, Bitboard to_mask) {
-    generate_quiet_queen_promotion(type, to_mask);
-    generate_quiet_underpromotions(type, to_mask);
+template<Color Us, Type T>
+void MoveGenerator::generate_quiet_promotions(Bitboard to_mask) {
+    generate_quiet_queen_promotion<Us, T>(to_mask);
+    generate_quiet_underpromotions<Us, T>(to_mask);
 }
 
+template<Color Us>
 Bitboard MoveGenerator::pawn_captures(Direction d) const {
-    auto pawns = board_.bb(piece::Pawn, board_.turn());
+    auto pawns = board_.bb(piece::Pawn, Us);
     // Do not & with color_bb[!turn] here. to_mask may contain ep square
-    return bb::shift(pawns, d, board_.turn());
+    return bb::shift(pawns, d, Us);
 }
 
+template<Color Us>
 void MoveGenerator::generate_normal_pawn_captures(Direction d,
                                                   Bitboard to_mask) {
-    auto tos = pawn_captures(d) & ~rank_8() & to_mask;
+    auto tos = pawn_captures<Us>(d) & ~rank_8<Us>() & to_mask;
     while (tos != bb::Empty) {
         auto to = bb::next_sq(tos);
-        add(square::sub(to, d, board_.turn()), to);
+        add_pawn(square::sub(to, d, Us), to);
     }
 }
 
+template<Color Us>
 void MoveGenerator::generate_promotion_captures(Direction d, Bitboard to_mask) {
-    auto tos = pawn_captures(d) & rank_8() & to_mask;
+    auto tos = pawn_captures<Us>(d) & rank_8<Us>() & to_mask;
     while (tos != bb::Empty) {
         auto to = bb::next_sq(tos);
         for (Piece pc = piece::Queen; pc >= piece::Knight; pc--) {
-            add(square::sub(to, d, board_.turn()), to, pc);
+            add_pawn(square::sub(to, d, Us), to, pc);
         }
     }
 }
 
 // All captures including promotions
-void MoveGenerator::generate_pawn_captures(Type type, Bitboard to_mask) {
-    if (type == Quiets) {
+template<Color Us, Type T>
+void MoveGenerator::generate_pawn_captures(Bitboard to_mask) {
+    if constexpr (T == Quiets) {
         return;
     }
-    to_mask = pawn_capture_to_mask(type, to_mask);
+    to_mask = pawn_capture_to_mask<Us>(to_mask);
     for (auto d : {dir::NW, dir::NE}) {
-        generate_normal_pawn_captures(d, to_mask);
-        generate_promotion_captures(d, to_mask);
+        generate_normal_pawn_captures<Us>(d, to_mask);
+        generate_promotion_captures<Us>(d, to_mask);
     }
 }
 
-void MoveGenerator::generate_pawn(Type type, Bitboard to_mask) {
-    generate_single_pushes(to_mask);
-    generate_double_pushes(to_mask);
-    generate_quiet_promotions(type, to_mask);
-    generate_pawn_captures(type, to_mask);
+template<Color Us, Type T>
+void MoveGenerator::generate_pawn(Bitboard to_mask) {
+    generate_single_pushes<Us>(to_mask);
+    generate_double_pushes<Us>(to_mask);
+    generate_quiet_promotions<Us, T>(to_mask);
+    generate_pawn_captures<Us, T>(to_mask);
 }
 
 void MoveGenerator::generate_piece(Piece pc, Bitboard froms, Bitboard to_mask) {
     assert(pc != piece::Pawn);
     while (froms != bb::Empty) {
         auto from = bb::next_sq(froms);
-        auto tos = lookup::attacks(pc, from, board_.all()) & to_mask;
+        auto tos = lookup::attacks(pc, from, board_.all()) & to_mask &
+                   pin_mask(from);
         while (tos != bb::Empty) {
             auto to = bb::next_sq(tos);
             add(from, to);
@@ -287,11 +484,14 @@ void MoveGenerator::generate_piece(Piece pc, Bitboard froms, Bitboard to_mask) {
     }
 }
 
-void MoveGenerator::generate_castlings(Type type) {
-    if (type == Quiets) {
-        for (Castling c = 0; c < 4; c++) {
+template<Color Us, Type T>
+void MoveGenerator::generate_castlings() {
+    if constexpr (T == Quiets) {
+        auto first = Us == color::White ? castling::WhiteKingside
+                                        : castling::BlackKingside;
+        for (Castling c = first; c < first + 2; c++) {
             auto &ci = board::CASTLING_INFO[c];
-            if (bi_.king_sq == ci.king_from) {
+            if (bi_.king_sq == ci.king_from && board_.can_castle(c)) {
                 add(ci.king_from, ci.king_to);
             }
         }
@@ -302,18 +502,11 @@ void MoveGenerator::generate_all() {
     if (board_.in_check()) {
         generate(Evasions);
     } else {
-        generate(Quiets);
-        auto quiets = moves_;
         generate(Captures);
-        moves_.insert(moves_.end(), quiets.begin(), quiets.end());
+        generate_moves(Quiets);
     }
 }
 
-void MoveGenerator::filter_legal(MoveGenerator &gen) {
-    std::erase_if(gen.moves_,
-                  [&gen](Move move) { return !gen.board_.is_legal(move); });
-}
-
 bool on_board(Square from, Direction d, i32 k = 1) {
     if (k > 7) {
         return false;
@@ -331,7 +524,9 @@ bool on_board(Square from, Direction d, i32 k = 1) {
 void check_pseudo_legal(std::unordered_set<Move> &moves, const Board &board,
                         Square from, Square to, Piece promotion) {
     auto m = move::init(from, to, promotion);
-    if (moves.contains(m) != board.is_pseudo_legal(m)) {
+    // Only legal moves are generated
+    auto is_legal = board.is_pseudo_legal(m) && board.is_legal(m);
+    if (moves.contains(m) != is_legal) {
         logging::debug("board.is_pseudo_legal({}): {}", move::to_str(m),
                        board.is_pseudo_legal(m));
         std::string s;
@@ -349,8 +544,11 @@ void check_pseudo_legal(std::unordered_set<Move> &moves, const Board &board,
 void check_pseudo_legal(std::unordered_set<Move> &moves, const Board &board,
                         Square from, Square to) {
     check_pseudo_legal(moves, board, from, to, piece::None);
-    // Possible promotion
-    if (square::rank(from) == rank::_7 && square::rank(to) == rank::_8) {
+    // Possible promotion, for either side
+    auto from_rk = square::rank(from);
+    auto to_rk = square::rank(to);
+    if ((from_rk == rank::_7 && to_rk == rank::_8) ||
+        (from_rk == rank::_2 && to_rk == rank::_1)) {
         if (abs(square::file(to) - square::file(from)) <= 1) {
             for (Piece pc = piece::Knight; pc <= piece::Queen; pc++) {
                 check_pseudo_legal(moves, board, from, to, pc);
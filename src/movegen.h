@@ -1,7 +1,12 @@
 #ifndef TUNA_MOVEGEN_H
 #define TUNA_MOVEGEN_H
 
+#include <array>
+#include <atomic>
+#include <vector>
+
 #include "board.h"
+#include "cfg.h"
 #include "common.h"
 
 namespace tuna::movegen {
@@ -10,9 +15,53 @@ using board::Board;
 
 enum Type { Evasions, Captures, Quiets };
 
+// Fixed-capacity move list stored inline, so generating moves never
+// allocates. No position has more than 218 legal moves.
+class MoveList {
+public:
+    void push_back(Move move);
+    void clear();
+    // Can only shrink the list
+    void resize(i32 size);
+
+    i32 size() const;
+    bool empty() const;
+
+    Move operator[](i32 i) const;
+
+    Move *begin();
+    Move *end();
+    const Move *begin() const;
+    const Move *end() const;
+
+private:
+    std::array<Move, cfg::MOVE_LIST_CAP> moves_;
+    i32 size_ = 0;
+};
+
+// Caches perft subtree counts by position hash and depth. Always replaces.
+// Lockless like tt::Tt: the key is stored XORed with the data, so an entry
+// torn by racing stores fails the key check.
+class PerftTable {
+public:
+    PerftTable(u64 mb = cfg::PERFT_HASH_MB);
+
+    bool probe(Hash hash, i32 depth, u64 &nodes) const;
+    void store(Hash hash, i32 depth, u64 nodes);
+
+private:
+    struct Entry {
+        std::atomic<u64> key;
+        std::atomic<u64> data;  // nodes << 8 | depth
+    };
+
+    std::vector<Entry> entries_;
+};
+
 struct BoardInfo {
     Bitboard king_bb;
     Square king_sq;
+    Bitboard pinned;
 };
 
 class MoveGenerator {
@@ -20,54 +69,85 @@ public:
     MoveGenerator(const Board &board);
 
     void generate(Type type);
+    // Every legal move: evasions when in check, else captures and quiets
+    void generate_all();
 
-    const std::vector<Move> &moves() const;
+    const MoveList &moves() const;
 
     static bool has_legal_move(const Board &board);
     static bool is_legal_move(const Board &board, Move move);
 
-    static u64 perft(Board &board, i32 depth, bool is_root = true);
+    // Counts the legal moves at depth 1 instead of making them. Subtree
+    // counts are cached in table when one is given
+    static u64 perft(Board &board, i32 depth, bool is_root = true,
+                     PerftTable *table = nullptr);
+    // Root moves are handed out to threads one at a time, each searching
+    // its own copy of the board. Prints the same divide output as perft,
+    // followed by the time taken and nps
+    static u64 perft_parallel(const Board &board, i32 depth, i32 threads,
+                              PerftTable *table = nullptr);
     static u64 perft_pseudo_legal(Board &board, i32 depth, bool is_root = true);
 
 private:
+    template<Color Us, Type T>
+    void generate_moves();
+
     void update_boardinfo();
 
-    Bitboard get_to_mask(Type type) const;
+    template<Color Us, Type T>
+    Bitboard get_to_mask() const;
 
     void add(Square from, Square to, Piece promotion = piece::None);
+    void add_pawn(Square from, Square to, Piece promotion = piece::None);
+
+    Bitboard pin_mask(Square from) const;
+    Bitboard king_to_mask(Bitboard to_mask) const;
 
-    Bitboard rank_8() const;
+    template<Color Us>
     Bitboard single_pushes() const;
+    template<Color Us>
     void generate_single_pushes(Bitboard to_mask);
 
+    template<Color Us>
     Bitboard double_pushes() const;
+    template<Color Us>
     void generate_double_pushes(Bitboard to_mask);
 
-    Bitboard pawn_capture_to_mask(Type type, Bitboard to_mask) const;
+    template<Color Us>
+    Bitboard pawn_capture_to_mask(Bitboard to_mask) const;
 
+    template<Color Us>
     Bitboard quiet_promotion_tos(Bitboard to_mask) const;
 
-    void generate_quiet_queen_promotion(Type type, Bitboard to_mask);
-    void generate_quiet_underpromotions(Type type, Bitboard to_mask);
-    void generate_quiet_promotions(Type type, Bitboard to_mask);
+    template<Color Us, Type T>
+    void generate_quiet_queen_promotion(Bitboard to_mask);
+    template<Color Us, Type T>
+    void generate_quiet_underpromotions(Bitboard to_mask);
+    template<Color Us, Type T>
+    void generate_quiet_promotions(Bitboard to_mask);
 
+    template<Color Us>
     Bitboard pawn_captures(Direction d) const;
+    template<Color Us>
     void generate_normal_pawn_captures(Direction d, Bitboard to_mask);
+    template<Color Us>
     void generate_promotion_captures(Direction d, Bitboard to_mask);
     // All captures including promotions
-    void generate_pawn_captures(Type type, Bitboard to_mask);
+    template<Color Us, Type T>
+    void generate_pawn_captures(Bitboard to_mask);
 
-    void generate_pawn(Type type, Bitboard to_mask);
+    template<Color Us, Type T>
+    void generate_pawn(Bitboard to_mask);
     void generate_piece(Piece pc, Bitboard froms, Bitboard to_mask);
-    void generate_castlings(Type type);
+    template<Color Us, Type T>
+    void generate_castlings();
 
-    void generate_all();
+    void generate_moves(Type type);
 
-    static void filter_legal(MoveGenerator &gen);
     static void check_pseudo_legal(MoveGenerator &gen);
 
     const Board &board_;
-    std::vector<Move> moves_;
+    MoveList moves_;
     BoardInfo bi_;  // tmp variable
 };
 
@@ -77,8 +157,14 @@ constexpr auto has_legal_move = &MoveGenerator::has_legal_move;
 constexpr auto is_legal_move = &MoveGenerator::is_legal_move;
 
 // Have to use functions to get default arguments working
-inline u64 perft(Board &board, i32 depth, bool is_root = true) {
-    return MoveGenerator::perft(board, depth, is_root);
+inline u64 perft(Board &board, i32 depth, bool is_root = true,
+                 PerftTable *table = nullptr) {
+    return MoveGenerator::perft(board, depth, is_root, table);
+}
+
+inline u64 perft_parallel(const Board &board, i32 depth, i32 threads,
+                          PerftTable *table = nullptr) {
+    return MoveGenerator::perft_parallel(board, depth, threads, table);
 }
 
 inline u64 perft_pseudo_legal(Board &board, i32 depth, bool is_root = true) {
@@ -35,7 +35,8 @@ MovePicker::MovePicker(Board &board, Type type, Move tt_move,
                        std::array<Move, cfg::KILLERS_COUNT> &killers,
                        ButterflyHistory &butterfly_hist)
     : board_(board), gen_(board), tt_move_(tt_move), killers_(killers),
-      butterfly_hist_(butterfly_hist), skip_quiets_(false) {
+      butterfly_hist_(butterfly_hist), bad_captures_end_(moves_.data()),
+      skip_quiets_(false) {
     using namespace stage;
     if (board.in_check()) {
         stage_ = EvasionsTt;
@@ -56,6 +57,10 @@ void MovePicker::skip_quiet_moves() {
     skip_quiets_ = true;
 }
 
+bool MovePicker::skips_quiet_moves() const {
+    return skip_quiets_;
+}
+
 MoveScore MovePicker::mvv_lva(Move move) const {
     auto lva = board_.piece_on(move::from(move));
     auto mvv = board_.piece_on(move::to(move));
@@ -97,13 +102,21 @@ MoveScore MovePicker::score_move(movegen::Type type, Move move) const {
     }
 }
 
-void MovePicker::sort_moves(movegen::Type type) {
-    auto gen_moves = gen_.moves();
-    moves_.resize(gen_moves.size());
+// Scores into cur_ onwards
+void MovePicker::score_moves(movegen::Type type) {
+    auto &gen_moves = gen_.moves();
+    end_ = cur_ + gen_moves.size();
     for (auto i = 0; i < gen_moves.size(); i++) {
-        moves_[i] = {gen_moves[i], score_move(type, gen_moves[i])};
+        cur_[i] = {gen_moves[i], score_move(type, gen_moves[i])};
     }
-    std::sort(moves_.begin(), moves_.end());
+}
+
+// Selection sort one move at a time. Most cut nodes only look at the
+// first one or two moves, so sorting the whole list is wasted work.
+ScoredMove MovePicker::pick_best() {
+    auto best = std::min_element(cur_, end_);
+    std::swap(*cur_, *best);
+    return *cur_++;
 }
 
 void MovePicker::init_killers() {
@@ -111,10 +124,17 @@ void MovePicker::init_killers() {
     stage_++;
 }
 
+void MovePicker::init_bad_captures() {
+    cur_ = moves_.data();
+    end_ = bad_captures_end_;
+    stage_++;
+}
+
+// Quiets are scored behind the bad captures
 void MovePicker::generate(movegen::Type type) {
     gen_.generate(type);
-    sort_moves(type);
-    cur_ = moves_.begin();
+    cur_ = type == movegen::Quiets ? bad_captures_end_ : moves_.data();
+    score_moves(type);
     stage_++;
 }
 
@@ -139,15 +159,30 @@ bool MovePicker::is_repeated_move(Move move) const {
 }
 
 Move MovePicker::retrieve_next() {
-    while (cur_ != moves_.end()) {
-        auto move = cur_++->move;
-        if (!is_repeated_move(move) && board_.is_legal(move)) {
+    while (cur_ != end_) {
+        auto move = pick_best().move;
+        if (!is_repeated_move(move)) {
             return move;
         }
     }
     return move::Null;
 }
 
+// Captures losing material are kept for later instead
+Move MovePicker::retrieve_next_good_capture() {
+    while (cur_ != end_) {
+        auto sm = pick_best();
+        if (is_repeated_move(sm.move)) {
+            continue;
+        }
+        if (board_.see(sm.move, 0)) {
+            return sm.move;
+        }
+        *bad_captures_end_++ = sm;
+    }
+    return move::Null;
+}
+
 Move MovePicker::next() {
     Move move;
     switch (stage_) {
@@ -185,10 +220,21 @@ Move MovePicker::next() {
             stage_++;
             return next();
         }
-    case Evasions:
+    case MainBadCapturesInit:
+        init_bad_captures();
+        return next();
     case MainCaptures:
+        if (!skip_quiets_ &&
+            (move = retrieve_next_good_capture()) != move::Null) {
+            return move;
+        } else {
+            stage_++;
+            return next();
+        }
+    case Evasions:
     case QsearchCaptures:
     case MainQuiets:
+    case MainBadCaptures:
         if (!skip_quiets_ && (move = retrieve_next()) != move::Null) {
             return move;
         } else {
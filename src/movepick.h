@@ -2,7 +2,6 @@
 #define TUNA_MOVEPICK_H
 
 #include <array>
-#include <vector>
 
 #include "board.h"
 #include "cfg.h"
@@ -34,6 +33,8 @@ enum {
     MainKillers,
     MainQuietsInit,
     MainQuiets,
+    MainBadCapturesInit,
+    MainBadCaptures,
     MainEnd,
 
     QsearchTt,
@@ -74,16 +75,22 @@ public:
     Iterator begin();
     Iterator end();
 
+    // Despite the name, every move not picked yet is skipped after this,
+    // captures and losing captures included, except the killers. Late move
+    // pruning thus prunes losing captures too
     void skip_quiet_moves();
+    bool skips_quiet_moves() const;
 
 private:
     MoveScore mvv_lva(Move move) const;
     MoveScore history_score(Move move) const;
 
     MoveScore score_move(movegen::Type type, Move move) const;
-    void sort_moves(movegen::Type type);
+    void score_moves(movegen::Type type);
+    ScoredMove pick_best();
 
     void init_killers();
+    void init_bad_captures();
 
     void generate(movegen::Type type);
 
@@ -92,6 +99,7 @@ private:
     Move next_killer();
     bool is_repeated_move(Move move) const;
     Move retrieve_next();
+    Move retrieve_next_good_capture();
     Move next();
 
     Board &board_;
@@ -101,8 +109,13 @@ private:
     std::array<Move, cfg::KILLERS_COUNT>::iterator cur_killer_;
     ButterflyHistory &butterfly_hist_;
     Stage stage_;
-    std::vector<ScoredMove>::iterator cur_;
-    std::vector<ScoredMove> moves_;
+    // Scored moves of the current stage, kept inline so that picking
+    // never allocates. Captures that lose material are moved to the front
+    // of moves_ and tried after the quiets, which are scored behind them.
+    ScoredMove *cur_;
+    ScoredMove *end_;
+    ScoredMove *bad_captures_end_;
+    std::array<ScoredMove, cfg::MOVE_LIST_CAP> moves_;
     bool skip_quiets_;
 };
 
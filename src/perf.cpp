@@ -1,10 +1,9 @@
 #include "perf.h"
 
-#include <algorithm>
+#include <array>
+#include <atomic>
+#include <memory>
 #include <mutex>
-#include <string>
-#include <unordered_map>
-#include <utility>
 #include <vector>
 
 #include "common.h"
@@ -12,15 +11,51 @@
 
 namespace tuna::perf {
 
-std::unordered_map<std::string, u64> counters;
+constinit thread_local Block *local_block = nullptr;
+
+namespace {
+
 std::mutex mx;
+std::vector<std::unique_ptr<Block>> blocks;
+std::vector<Block *> free_blocks;
+
+struct Releaser {
+    ~Releaser() {
+        std::lock_guard<std::mutex> lock(mx);
+        free_blocks.push_back(local_block);
+        local_block = nullptr;
+    }
+};
+
+}  // namespace
+
+Block *acquire_block() {
+    thread_local Releaser releaser;
+    std::lock_guard<std::mutex> lock(mx);
+    if (!free_blocks.empty()) {
+        auto block = free_blocks.back();
+        free_blocks.pop_back();
+        return block;
+    }
+    blocks.push_back(std::make_unique<Block>());
+    return blocks.back().get();
+}
 
 void annotate() {
-    auto sorted_counters = std::vector<std::pair<std::string, u64>>(
-        counters.begin(), counters.end());
-    std::sort(sorted_counters.begin(), sorted_counters.end());
-    for (auto &[name, cnt] : sorted_counters) {
-        logging::debug("{}: {}", name, cnt);
+    if constexpr (!cfg::PERF_COUNTERS) {
+        return;
+    }
+    std::array<u64, Size> totals{};
+    {
+        std::lock_guard<std::mutex> lock(mx);
+        for (auto &block : blocks) {
+            for (auto i = 0; i < Size; i++) {
+                totals[i] += block->counts[i].load(std::memory_order_relaxed);
+            }
+        }
+    }
+    for (auto i = 0; i < Size; i++) {
+        logging::debug("{}: {}", NAMES[i], totals[i]);
     }
 }
 
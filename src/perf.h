@@ -1,26 +1,51 @@
 #ifndef TUNA_PERF_H
 #define TUNA_PERF_H
 
-#include <format>
-#include <mutex>
-#include <string>
-#include <unordered_map>
-#include <utility>
+#include <array>
+#include <atomic>
+#include <string_view>
 
+#include "cfg.h"
 #include "common.h"
 
 namespace tuna::perf {
 
-extern std::unordered_map<std::string, u64> counters;
-extern std::mutex mx;
-
-template<class... Args>
-void record(std::format_string<Args...> format, Args &&...args) {
-    auto name = std::format(format, std::forward<Args>(args)...);
-    std::lock_guard<std::mutex> lock(mx);
-    counters[name]++;
+// Calls into primitives below search. Search events such as nodes and
+// cutoffs are counted by the searcher stats instead. Add a counter before
+// Size and its name to NAMES
+enum Counter { MoveGenerations, Evaluations, SeeCalls, Size };
+
+const auto NAMES = std::array<std::string_view, Size>{
+    "move generations",
+    "evaluations",
+    "see calls",
+};
+
+// Each thread counts into its own block, padded to whole cache lines so
+// that threads never write to the same line. Relaxed atomics let annotate
+// read while threads count, and compile to plain loads and stores
+struct alignas(64) Block {
+    std::array<std::atomic<u64>, Size> counts{};
+};
+
+// Blocks are handed back when a thread exits and reused by the next one,
+// so no count is lost
+Block *acquire_block();
+
+constinit extern thread_local Block *local_block;
+
+inline void record(Counter counter) {
+    if constexpr (cfg::PERF_COUNTERS) {
+        if (!local_block) [[unlikely]] {
+            local_block = acquire_block();
+        }
+        auto &cnt = local_block->counts[counter];
+        cnt.store(cnt.load(std::memory_order_relaxed) + 1,
+                  std::memory_order_relaxed);
+    }
 }
 
+// Logs the totals over all threads
 void annotate();
 
 }  // namespace tuna::perf
@@ -7,9 +7,12 @@
 #include <array>
 #include <atomic>
 #include <chrono>
+#include <format>
 #include <limits>
+#include <new>
 #include <optional>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include "bb.h"
@@ -26,26 +29,32 @@ const auto MILLIS_MAX = std::numeric_limits<Millis>::max();
 
 auto LMR_REDUCTION = std::array<std::array<Depth, 64>, 64>();
 
-Searcher::Searcher(Board &board) : board_(board) {}
+Searcher::Searcher(ThreadPool &pool, bool is_main)
+    : pool_(pool), is_main_(is_main), stop_requested_(pool.stop_requested_),
+      tt_(pool.tt_), butterfly_hist_(), stats_enabled_(false), stats_() {}
 
 void Searcher::new_game() {
-    tt_.clear();
     butterfly_hist_ = {};
 }
 
-void Searcher::resize_tt(u64 mb) {
-    tt_.resize(mb);
-}
-
-// Must pass by value because we make a copy in std::thread
-void Searcher::go(GoCmd cmd) {
+// Each searcher works on its own copy of the root position
+void Searcher::go(const Board &board, GoCmd cmd) {
+    board_ = board;
     new_search(cmd);
     iterative_deepening();
-    print_bestmove();
 }
 
-void Searcher::stop() {
-    stop_requested_ = true;
+void Searcher::print_bestmove() const {
+    assert(bestmove_ != move::Null);
+    io::println("bestmove {}", move::to_str(bestmove_));
+}
+
+u64 Searcher::nodes() const {
+    return node_cnt_.load(std::memory_order_relaxed);
+}
+
+const DepthStats &Searcher::stats() const {
+    return stats_;
 }
 
 void Searcher::allocate_time(GoCmd &cmd) {
@@ -67,7 +76,6 @@ void Searcher::allocate_time(GoCmd &cmd) {
 
 void Searcher::new_search(GoCmd &cmd) {
     clock_start_ = clock::now();
-    stop_requested_ = false;
     max_depth_ = cmd.depth ? *cmd.depth : PLY_MAX;
     bestmove_ = move::Null;
     node_cnt_ = 0;
@@ -76,12 +84,17 @@ void Searcher::new_search(GoCmd &cmd) {
     iter_depth_ = 0;
     cur_ply_ = 0;
     allocate_time(cmd);
-    stk_ = {};
-    stk_.resize(cur_ply_ + 1);
+    stats_enabled_ = pool_.stats_enabled_;
+    if (stats_enabled_) {
+        stats_ = {};
+    }
+    stk_[0].clear_killers();
+    stk_[0].pv_len = 0;
+    stk_[1].clear_killers();
 }
 
 void Searcher::reset_info() {
-    stk_.resize(cur_ply_ + 1);
+    stk_[cur_ply_ + 1].clear_killers();
 }
 
 Millis Searcher::elapsed() const {
@@ -97,22 +110,35 @@ bool Searcher::within_time_limit(Millis millis) const {
 }
 
 void Searcher::check_limits_reached() {
-    if (node_cnt_ % cfg::SEARCH_POLL_NODE_FREQ == 0 && iter_depth_ > 1) {
+    if (!is_main_) {
+        return;
+    }
+    if (nodes() % cfg::SEARCH_POLL_NODE_FREQ == 0 && iter_depth_ > 1) {
         if (!within_time_limit(elapsed())) {
             stop_requested_ = true;
         }
     }
 }
 
+void Searcher::record(i32 stat) {
+    if (stats_enabled_) {
+        stats_[iter_depth_][stat]++;
+    }
+}
+
 void Searcher::make_move_end() {
-    node_cnt_++;
+    // Only this thread writes node_cnt_, so no atomic increment is needed
+    node_cnt_.store(nodes() + 1, std::memory_order_relaxed);
     check_limits_reached();
     cur_ply_++;
-    stk_.resize(cur_ply_ + 1);
-    stk_[cur_ply_].pv_line.clear();
+    stk_[cur_ply_].pv_len = 0;
+    // Children of the new node start with no killers
+    stk_[cur_ply_ + 1].clear_killers();
 }
 
+// The TT bucket of the child is fetched while we make the move
 void Searcher::make_move(Move move) {
+    tt_.prefetch(board_.hash_after(move));
     board_.make_move(move);
     make_move_end();
 }
@@ -127,11 +153,11 @@ void Searcher::unmake_move() {
 }
 
 void Searcher::update_pv_line(Move move) {
-    auto &pv_line = stk_[cur_ply_].pv_line;
-    auto &child_pv = stk_[cur_ply_ + 1].pv_line;
-    pv_line.clear();
-    pv_line.push_back(move);
-    pv_line.insert(pv_line.end(), child_pv.begin(), child_pv.end());
+    auto &info = stk_[cur_ply_];
+    auto &child = stk_[cur_ply_ + 1];
+    info.pv[0] = move;
+    std::copy_n(child.pv.begin(), child.pv_len, info.pv.begin() + 1);
+    info.pv_len = child.pv_len + 1;
 }
 
 Score Searcher::qsearch(Score alpha, Score beta) {
@@ -139,27 +165,51 @@ Score Searcher::qsearch(Score alpha, Score beta) {
     if (stop_requested_) {
         return 0;
     }
+    record(stat::QsearchNodes);
     if (cur_ply_ == PLY_MAX) {
         return eval::evaluate(board_);
     }
     if (board_.is_draw()) {
         return score::DRAW;
     }
+    // Qsearch entries are stored at depth 0, which any entry satisfies
+    auto tte = cfg::QSEARCH_TT ? tt_.probe(board_.hash()) : tt::Entry();
+    if (tte.is_valid()) {
+        auto tts = tte.search_score(cur_ply_);
+        if (tte.bound() & tt::Lower && tts >= beta) {
+            return tts;
+        }
+        if (tte.bound() & tt::Upper && tts <= alpha) {
+            return tts;
+        }
+    }
     // TT move here makes things worse
     MovePicker mp(board_, movepick::Qsearch, move::Null, stk_[cur_ply_].killers,
                   butterfly_hist_);
+    auto static_eval =
+        tte.is_valid() ? tte.static_eval() : eval::evaluate(board_);
+    auto old_alpha = alpha;
     auto best_score = score::MIN;
+    auto best_move = move::Null;
     if (!board_.in_check()) {
         // Can only stand pat when not in check
-        best_score = eval::evaluate(board_);
+        best_score = static_eval;
     }
     if (best_score > alpha) {
         alpha = best_score;
         if (best_score >= beta) {
+            if (cfg::QSEARCH_TT) {
+                tt_.store(board_.hash(), move::Null, best_score, static_eval,
+                          0, tt::Lower, cur_ply_);
+            }
             return best_score;
         }
     }
     for (auto move : mp) {
+        // Captures losing material are not worth resolving
+        if (!board_.in_check() && !board_.see(move, 0)) {
+            continue;
+        }
         make_move(move);
         auto score = -qsearch(-beta, -alpha);
         unmake_move();
@@ -167,6 +217,7 @@ Score Searcher::qsearch(Score alpha, Score beta) {
             best_score = score;
             if (score > alpha) {
                 alpha = score;
+                best_move = move;
                 if (score >= beta) {
                     break;
                 }
@@ -178,6 +229,13 @@ Score Searcher::qsearch(Score alpha, Score beta) {
     if (best_score == score::MIN) {
         return score::mate(cur_ply_);
     }
+    if (cfg::QSEARCH_TT) {
+        auto ttb = best_score >= beta       ? tt::Lower
+                   : best_score > old_alpha ? tt::Exact
+                                            : tt::Upper;
+        tt_.store(board_.hash(), best_move, best_score, static_eval, 0, ttb,
+                  cur_ply_);
+    }
     return best_score;
 }
 
@@ -211,6 +269,7 @@ Depth Searcher::nmp_reduction(Depth depth) const {
 }
 
 void Searcher::make_null_move() {
+    tt_.prefetch(board_.hash_after(move::Null));
     board_.make_null_move();
     make_move_end();
 }
@@ -225,6 +284,16 @@ bool Searcher::can_lmp(Depth depth, i32 moves_played) const {
     return depth <= 2 && moves_played >= 4 + 6 * depth;
 }
 
+// SEE pruning. Only once a move has been searched (score::MIN is a mate
+// score too), so that a node is never left without any move
+bool Searcher::can_see_prune(Depth depth, Score best_score) const {
+    return depth <= 6 && !score::is_mate(best_score);
+}
+
+Score Searcher::see_margin(Depth depth, bool is_capture) const {
+    return is_capture ? -100 * depth : -30 * depth * depth;
+}
+
 // Extensions (currently only check extension)
 Depth Searcher::extension(bool gives_check) const {
     return gives_check;
@@ -288,7 +357,7 @@ void Searcher::update_butterfly_history(Move move, HistoryScore clamped_bonus) {
 }
 
 void Searcher::update_butterfly_history(Move move,
-                                        std::vector<Move> &quiets_played,
+                                        const movegen::MoveList &quiets_played,
                                         Depth depth) {
     auto bonus = butterfly_history_bonus(depth);
     auto clamped_bonus = clamp_history_score(bonus);
@@ -301,7 +370,7 @@ void Searcher::update_butterfly_history(Move move,
 }
 
 void Searcher::update_quiet_histories(Move move,
-                                      std::vector<Move> &quiets_played,
+                                      const movegen::MoveList &quiets_played,
                                       Depth depth) {
     update_killers(move);
     update_butterfly_history(move, quiets_played, depth);
@@ -322,38 +391,53 @@ Score Searcher::pvs(Depth depth, Score alpha, Score beta) {
     if (board_.is_draw()) {
         return score::DRAW;
     }
+    record(stat::PvsNodes);
     auto is_root_node = cur_ply_ == 0;
     auto is_pv_node = beta - alpha > 1;
-    tt::Entry &tte = tt_.find(board_.hash());
+    auto tte = tt_.probe(board_.hash());
     auto ttm = move::Null;
     if (tte.is_valid()) {
+        record(stat::TtHits);
         ttm = tte.move();
         auto tts = tte.search_score(cur_ply_);
         // Only using TT cutoffs when not PV does not seem to improve
         // strength. Worse by ~4 ELO after 2000 games (10+0.1)
         if (tte.depth() >= depth) {
             if (tte.bound() & tt::Lower && tts >= beta) {
+                record(stat::TtCutoffs);
                 return tts;
             }
             if (tte.bound() & tt::Upper && tts <= alpha) {
+                record(stat::TtCutoffs);
                 return tts;
             }
         }
     }
-    auto eval =
-        tte.is_valid() ? tte.search_score(cur_ply_) : eval::evaluate(board_);
+    auto static_eval =
+        tte.is_valid() ? tte.static_eval() : eval::evaluate(board_);
+    auto eval = static_eval;
+    // The search score is a better estimate when its bound allows it
+    if (tte.is_valid()) {
+        auto tts = tte.search_score(cur_ply_);
+        if (tte.bound() & (tts > eval ? tt::Lower : tt::Upper)) {
+            eval = tts;
+        }
+    }
     if (can_rfp(is_pv_node, depth)) {
         auto margin = rfp_margin(depth);
         if (eval - margin >= beta) {
+            record(stat::RfpCutoffs);
             return eval;
         }
     }
     if (can_nmp(is_pv_node, depth, eval, beta)) {
+        record(stat::NmpTries);
         Depth reduction = nmp_reduction(depth);
         make_null_move();
         Score score = -pvs(depth - reduction - 1, -beta, -beta + 1);
         unmake_null_move();
         if (score >= beta) {
+            record(stat::NmpCutoffs);
             return score;
         }
     }
@@ -363,16 +447,24 @@ Score Searcher::pvs(Depth depth, Score alpha, Score beta) {
     auto best_move = move::Null;
     auto ttb = tt::Upper;
     auto in_check = board_.in_check();
-    std::vector<Move> quiets_played;
-    // TODO: Find out why wrapping this in an `if (!in_check)` condition
-    // changes the number of nodes searched
-    quiets_played.reserve(cfg::MOVE_VEC_RESERVE_CAP);
+    // Children use the next stack entry, so these survive the recursion
+    auto &quiets_played = stk_[cur_ply_].quiets_played;
+    auto &captures_played = stk_[cur_ply_].captures_played;
+    quiets_played.clear();
+    captures_played.clear();
     auto moves_played = 0;
     for (auto move : mp) {
         auto is_capture = board_.is_capture(move);
-        if (!is_root_node && can_lmp(depth, moves_played)) {
+        if (!is_root_node && !mp.skips_quiet_moves() &&
+            can_lmp(depth, moves_played)) {
+            record(stat::LmpNodes);
             mp.skip_quiet_moves();
         }
+        if (!is_root_node && can_see_prune(depth, best_score) &&
+            !board_.see(move, see_margin(depth, is_capture))) {
+            record(stat::SeePrunes);
+            continue;
+        }
         make_move(move);
         auto is_first_move = moves_played == 0;
         auto gives_check = board_.in_check();
@@ -386,11 +478,16 @@ Score Searcher::pvs(Depth depth, Score alpha, Score beta) {
             if (can_lmr(depth)) {
                 red = lmr(depth, moves_played, is_pv_node);
             }
+            if (red > 0) {
+                record(stat::LmrSearches);
+            }
             score = -pvs(new_depth - red, -alpha - 1, -alpha);
             if (score > alpha && red > 0) {
+                record(stat::LmrResearches);
                 score = -pvs(new_depth, -alpha - 1, -alpha);
             }
             if (score > alpha && is_pv_node) {
+                record(stat::PvsResearches);
                 score = -pvs(new_depth, -beta, -alpha);
             }
         }
@@ -402,6 +499,10 @@ Score Searcher::pvs(Depth depth, Score alpha, Score beta) {
                 alpha = score;
                 ttb = tt::Exact;
                 if (score >= beta) {
+                    record(stat::FailHighs);
+                    if (is_first_move) {
+                        record(stat::FirstMoveFailHighs);
+                    }
                     ttb = tt::Lower;
                     if (!in_check && !is_capture) {
                         update_quiet_histories(move, quiets_played, depth);
@@ -411,7 +512,9 @@ Score Searcher::pvs(Depth depth, Score alpha, Score beta) {
                 update_pv_line(move);
             }
         }
-        if (!in_check && !is_capture) {
+        if (is_capture) {
+            captures_played.push_back(move);
+        } else if (!in_check) {
             quiets_played.push_back(move);
         }
         moves_played++;
@@ -420,7 +523,8 @@ Score Searcher::pvs(Depth depth, Score alpha, Score beta) {
     if (best_score == score::MIN) {
         return board_.in_check() ? score::mate(cur_ply_) : score::DRAW;
     }
-    tte.update(board_.hash(), best_move, best_score, depth, ttb, cur_ply_);
+    tt_.store(board_.hash(), best_move, best_score, static_eval, depth, ttb,
+              cur_ply_);
     return best_score;
 }
 
@@ -447,9 +551,10 @@ void Searcher::aspiration_window(Depth depth) {
 
 std::string Searcher::pv_str() const {
     std::string pv_str;
-    auto &pv_line = stk_[0].pv_line;
+    auto &info = stk_[0];
     bool first = true;
-    for (auto move : pv_line) {
+    for (auto i = 0; i < info.pv_len; i++) {
+        auto move = info.pv[i];
         if (!first) {
             pv_str += ' ';
         }
@@ -462,25 +567,26 @@ std::string Searcher::pv_str() const {
 void Searcher::print_info() const {
     assert(!stop_requested_);
     auto millis = elapsed();
-    auto nps = static_cast<u64>(1000. * node_cnt_ / millis);
+    auto nodes = pool_.nodes();
+    auto nps = static_cast<u64>(1000. * nodes / millis);
     io::println(
         "info depth {} score {} nodes {} nps {} hashfull {} time {} pv {}",
-        iter_depth_, score::to_str(root_score_), node_cnt_, nps, tt_.hashfull(),
+        iter_depth_, score::to_str(root_score_), nodes, nps, tt_.hashfull(),
         millis, pv_str());
 }
 
 void Searcher::update_bestmove() {
-    assert(!stop_requested_ && !stk_[0].pv_line.empty());
-    bestmove_ = stk_[0].pv_line[0];
+    assert(!stop_requested_ && stk_[0].pv_len > 0);
+    bestmove_ = stk_[0].pv[0];
 }
 
 bool Searcher::can_search_next_depth() {
     // Not enough data to calculate branching factor
     if (iter_depth_ == 1) {
-        depth_one_node_cnt_ = node_cnt_;
+        depth_one_node_cnt_ = nodes();
         return true;
     }
-    auto base = static_cast<f64>(node_cnt_) / depth_one_node_cnt_;
+    auto base = static_cast<f64>(nodes()) / depth_one_node_cnt_;
     auto exp = 1.0 / (iter_depth_ - 1);
     auto branching_factor = pow(base, exp);
     return within_time_limit(elapsed() * branching_factor);
@@ -493,7 +599,13 @@ void Searcher::iterative_deepening() {
         if (stop_requested_) {
             return;
         }
+        if (!is_main_) {
+            continue;
+        }
         print_info();
+        if (stats_enabled_) {
+            io::println("info string stats {}", stats_str(stats_[iter_depth_]));
+        }
         update_bestmove();
         if (!can_search_next_depth()) {
             return;
@@ -501,9 +613,131 @@ void Searcher::iterative_deepening() {
     }
 }
 
-void Searcher::print_bestmove() const {
-    assert(bestmove_ != move::Null);
-    io::println("bestmove {}", move::to_str(bestmove_));
+ThreadPool::ThreadPool(Board &board) : board_(board), stats_enabled_(false) {
+    resize(1);
+}
+
+void ThreadPool::new_game() {
+    tt_.clear(searchers_.size());
+    for (auto &searcher : searchers_) {
+        searcher->new_game();
+    }
+}
+
+void ThreadPool::resize_tt(u64 mb) {
+    auto start = clock::now();
+    try {
+        tt_.resize(mb, searchers_.size());
+    } catch (const std::bad_alloc &) {
+        io::println("info string Failed to allocate {} MB of hash, kept {} MB",
+                    mb, tt_.mb());
+        return;
+    }
+    auto millis = std::chrono::duration_cast<std::chrono::milliseconds>(
+                      clock::now() - start)
+                      .count();
+    io::println("info string Hash {} MB allocated with {} in {} ms", mb,
+                tt::to_str(tt_.backing()), millis);
+}
+
+void ThreadPool::save_tt(const std::string &path) const {
+    if (!tt_.save(path)) {
+        io::println("info string Failed to save hash to {}", path);
+        return;
+    }
+    io::println("info string Hash saved to {}", path);
+}
+
+void ThreadPool::load_tt(const std::string &path) {
+    if (!tt_.load(path)) {
+        io::println("info string Failed to load hash from {}", path);
+        return;
+    }
+    io::println("info string Hash {} MB loaded from {}", tt_.mb(), path);
+}
+
+void ThreadPool::resize(i32 threads) {
+    assert(threads >= 1);
+    searchers_.clear();
+    for (auto i = 0; i < threads; i++) {
+        searchers_.push_back(std::make_unique<Searcher>(*this, i == 0));
+    }
+}
+
+i32 ThreadPool::threads() const {
+    return searchers_.size();
+}
+
+void ThreadPool::set_stats_enabled(bool enabled) {
+    stats_enabled_ = enabled;
+}
+
+bool ThreadPool::stats_enabled() const {
+    return stats_enabled_;
+}
+
+// Must pass by value because we make a copy in std::thread
+void ThreadPool::go(GoCmd cmd) {
+    stop_requested_ = false;
+    tt_.new_search();
+    std::vector<std::thread> helpers;
+    for (auto i = 1; i < searchers_.size(); i++) {
+        auto &helper = *searchers_[i];
+        helpers.emplace_back([this, &helper, cmd] { helper.go(board_, cmd); });
+    }
+    auto &main = *searchers_[0];
+    main.go(board_, cmd);
+    // Helpers have no depth or time limit of their own
+    stop_requested_ = true;
+    for (auto &helper : helpers) {
+        helper.join();
+    }
+    main.print_bestmove();
+}
+
+void ThreadPool::stop() {
+    stop_requested_ = true;
+}
+
+u64 ThreadPool::nodes() const {
+    u64 nodes = 0;
+    for (auto &searcher : searchers_) {
+        nodes += searcher->nodes();
+    }
+    return nodes;
+}
+
+DepthStats ThreadPool::stats() const {
+    DepthStats stats{};
+    for (auto &searcher : searchers_) {
+        for (auto depth = 0; depth <= PLY_MAX; depth++) {
+            for (auto i = 0; i < stat::Size; i++) {
+                stats[depth][i] += searcher->stats()[depth][i];
+            }
+        }
+    }
+    return stats;
+}
+
+// Percentages are of the parent count: TT hits of pvs nodes, TT cutoffs
+// of TT hits and first move fail highs of all fail highs
+std::string stats_str(const Stats &stats) {
+    using namespace stat;
+    auto percent = [](u64 part, u64 whole) {
+        return whole != 0 ? 100. * part / whole : 0.;
+    };
+    auto nodes = stats[PvsNodes] + stats[QsearchNodes];
+    return std::format(
+        "nodes {} qsearch {:.1f}% tthits {:.1f}% ttcutoffs {:.1f}% "
+        "failhighs {} firstmove {:.1f}% rfp {} nmp {}/{} lmp {} see {} "
+        "lmr {} lmrresearches {} pvsresearches {}",
+        nodes, percent(stats[QsearchNodes], nodes),
+        percent(stats[TtHits], stats[PvsNodes]),
+        percent(stats[TtCutoffs], stats[TtHits]), stats[FailHighs],
+        percent(stats[FirstMoveFailHighs], stats[FailHighs]),
+        stats[RfpCutoffs], stats[NmpCutoffs], stats[NmpTries],
+        stats[LmpNodes], stats[SeePrunes], stats[LmrSearches],
+        stats[LmrResearches], stats[PvsResearches]);
 }
 
 void init() {
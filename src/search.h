@@ -1,14 +1,17 @@
 #ifndef TUNA_SEARCH_H
 #define TUNA_SEARCH_H
 
+#include <array>
 #include <atomic>
 #include <chrono>
+#include <memory>
 #include <string>
 #include <vector>
 
 #include "board.h"
 #include "cfg.h"
 #include "common.h"
+#include "movegen.h"
 #include "tt.h"
 
 namespace tuna::search {
@@ -30,22 +33,64 @@ struct GoCmd {
 
 struct SearchInfo {
     SearchInfo() {
+        clear_killers();
+    }
+
+    void clear_killers() {
         std::fill(killers.begin(), killers.end(), move::Null);
     }
 
     std::array<Move, cfg::KILLERS_COUNT> killers;
-    std::vector<Move> pv_line;
+    // Row of the triangular PV array: the PV from this ply onwards
+    std::array<Move, PLY_MAX + 1> pv;
+    Ply pv_len = 0;
+    // Moves searched at this node that did not cause a cutoff
+    movegen::MoveList quiets_played;
+    movegen::MoveList captures_played;
 };
 
+namespace stat {
+
+enum {
+    PvsNodes,
+    QsearchNodes,
+    TtHits,
+    TtCutoffs,
+    FailHighs,
+    FirstMoveFailHighs,
+    RfpCutoffs,
+    NmpTries,
+    NmpCutoffs,
+    LmpNodes,  // Nodes where quiets were skipped
+    SeePrunes,
+    LmrSearches,
+    LmrResearches,
+    PvsResearches,  // Full window searches after a zero window fail high
+    Size,
+};
+
+}  // namespace stat
+
+// Counts of one iteration, kept when statistics are enabled. Events are
+// counted under the depth of the iteration, not the depth left at the node
+using Stats = std::array<u64, stat::Size>;
+using DepthStats = std::array<Stats, PLY_MAX + 1>;
+
+std::string stats_str(const Stats &stats);
+
+class ThreadPool;
+
 class Searcher {
 public:
-    Searcher(Board &board);
+    Searcher(ThreadPool &pool, bool is_main);
 
     void new_game();
-    void resize_tt(u64 mb);
 
-    void go(GoCmd cmd);
-    void stop();
+    void go(const Board &board, GoCmd cmd);
+    void print_bestmove() const;
+
+    u64 nodes() const;
+    const DepthStats &stats() const;
 
 private:
     void allocate_time(GoCmd &cmd);
@@ -57,6 +102,8 @@ private:
     bool within_time_limit(Millis millis) const;
     void check_limits_reached();
 
+    void record(i32 stat);
+
     void make_move_end();
     void make_move(Move move);
 
@@ -79,6 +126,9 @@ private:
 
     bool can_lmp(Depth depth, i32 moves_played) const;
 
+    bool can_see_prune(Depth depth, Score best_score) const;
+    Score see_margin(Depth depth, bool is_capture) const;
+
     Depth extension(bool gives_check) const;
 
     bool can_lmr(Depth depth) const;
@@ -91,9 +141,11 @@ private:
     HistoryScore &get_butterfly_history(Move move);
 
     void update_butterfly_history(Move move, HistoryScore clamped_bonus);
-    void update_butterfly_history(Move move, std::vector<Move> &quiets_played,
+    void update_butterfly_history(Move move,
+                                  const movegen::MoveList &quiets_played,
                                   Depth depth);
-    void update_quiet_histories(Move move, std::vector<Move> &quiets_played,
+    void update_quiet_histories(Move move,
+                                const movegen::MoveList &quiets_played,
                                 Depth depth);
 
     Score pvs(Depth depth, Score alpha, Score beta);
@@ -105,23 +157,60 @@ private:
     bool can_search_next_depth();
     void iterative_deepening();
 
-    void print_bestmove() const;
-
-    Board &board_;
+    ThreadPool &pool_;
+    bool is_main_;  // Only the main searcher manages time and prints
+    Board board_;
     std::chrono::time_point<clock> clock_start_;
-    std::atomic<bool> stop_requested_;
-    Tt tt_;
+    std::atomic<bool> &stop_requested_;
+    Tt &tt_;
     ButterflyHistory butterfly_hist_;
     Ply max_depth_;  // max_depth always > 0
     Move bestmove_;
-    u64 node_cnt_;
+    std::atomic<u64> node_cnt_;  // Read by the main searcher for reporting
     u64 depth_one_node_cnt_;
     Score root_score_;
     Ply iter_depth_;  // iter_depth always > 0
     Ply cur_ply_;
     Millis max_millis_;
-    // Can exceed PLY_MAX due to uci moves
-    std::vector<SearchInfo> stk_;
+    // One entry past PLY_MAX, as the child of each ply is reset on entry
+    std::array<SearchInfo, PLY_MAX + 2> stk_;
+    bool stats_enabled_;
+    DepthStats stats_;  // Indexed by iteration depth
+};
+
+// Lazy SMP: all searchers share the TT and search the same root position.
+// Searcher 0 is the main searcher, which reports info and bestmove.
+class ThreadPool {
+public:
+    ThreadPool(Board &board);
+
+    void new_game();
+    // Keeps the current table if the new one cannot be allocated
+    void resize_tt(u64 mb);
+    void save_tt(const std::string &path) const;
+    void load_tt(const std::string &path);
+    void resize(i32 threads);
+    i32 threads() const;
+    // Off by default, as counting costs a little in every node
+    void set_stats_enabled(bool enabled);
+    bool stats_enabled() const;
+
+    // Blocks until the search is finished
+    void go(GoCmd cmd);
+    void stop();
+
+    u64 nodes() const;
+    // Summed over all searchers
+    DepthStats stats() const;
+
+private:
+    friend class Searcher;
+
+    Board &board_;
+    std::atomic<bool> stop_requested_;
+    bool stats_enabled_;
+    Tt tt_;
+    std::vector<std::unique_ptr<Searcher>> searchers_;
 };
 
 void init();
@@ -1,22 +1,112 @@
 #include "tt.h"
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+#include <atomic>
 #include <bit>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <new>
+#include <string>
+#include <string_view>
+#include <thread>
 #include <vector>
 
 #include "common.h"
 
 namespace tuna::tt {
 
-u32 to_entry_hash(Hash hash) {
-    return static_cast<u32>(hash);
+// Not using _u64 because a Tt may be constructed during static initialization
+const u64 MB = 1024 * 1024;
+const u64 GB = 1024 * MB;
+
+std::string to_str(Backing backing) {
+    switch (backing) {
+    case HugePages1G:
+        return "1 GB huge pages";
+    case HugePages2M:
+        return "2 MB huge pages";
+    case TransparentHugePages:
+        return "transparent huge pages";
+    case Heap:
+        return "regular pages";
+    case FileMapping:
+        return "a file mapping";
+    default:
+        unreachable();
+    }
+}
+
+u64 round_up(u64 bytes, u64 page_size) {
+    return (bytes + page_size - 1) / page_size * page_size;
+}
+
+const auto FILE_MAGIC = std::string_view("TUNA TT");
+
+// Entries follow the header at an offset that is a multiple of the page
+// size, as required by mmap
+const u64 FILE_HEADER_BYTES = 64 * 1024;
+
+struct FileHeader {
+    std::array<char, 8> magic;
+    std::array<char, 64> version;  // Entry layout may change between versions
+    u64 size;
+    u8 generation;
+};
+
+static_assert(sizeof(FileHeader) <= FILE_HEADER_BYTES);
+
+FileHeader file_header(u64 size, u8 generation) {
+    FileHeader header{};
+    FILE_MAGIC.copy(header.magic.data(), header.magic.size() - 1);
+    std::strncpy(header.version.data(), TUNA_VERSION,
+                 header.version.size() - 1);
+    header.size = size;
+    header.generation = generation;
+    return header;
 }
 
-void Entry::invalidate() {
-    hash_ = 0;
+// hashfull samples the first buckets, so a table must have at least as many
+const u64 HASHFULL_BUCKETS = 1000;
+
+bool is_compatible(const FileHeader &header) {
+    auto expected = file_header(header.size, header.generation);
+    return header.magic == expected.magic &&
+           header.version == expected.version &&
+           std::has_single_bit(header.size) &&
+           header.size >= HASHFULL_BUCKETS &&
+           header.generation < GENERATION_CYCLE;
+}
+
+u16 to_entry_key(Hash hash) {
+    return static_cast<u16>(hash);
+}
+
+// depth: depth searched
+// ply: plies from root
+Entry::Entry(Move move, Score score, Score static_eval, Ply depth, Bound bound,
+             Ply ply, u8 generation)
+    : move_(move), score_(to_tt_score(score, ply)), static_eval_(static_eval),
+      depth_(depth), gen_bound_(generation << 2 | bound) {}
+
+Entry Entry::from_data(u64 data) {
+    return std::bit_cast<Entry>(data);
+}
+
+u64 Entry::data() const {
+    return std::bit_cast<u64>(*this);
 }
 
 bool Entry::is_valid() const {
-    return hash_ != 0;
+    return bound() != 0;
 }
 
 Score Entry::search_score(Ply ply) const {
@@ -29,22 +119,8 @@ Score Entry::search_score(Ply ply) const {
     return score_;
 }
 
-// depth: depth searched
-// ply: plies from root
-void Entry::update(Hash hash, Move move, Score score, Ply depth, Bound bound,
-                   Ply ply) {
-    auto eh = to_entry_hash(hash);
-    if (eh != this->hash_ || depth >= this->depth_) {
-        this->hash_ = eh;
-        this->move_ = move;
-        this->score_ = to_tt_score(score, ply);
-        this->depth_ = depth;
-        this->bound_ = bound;
-    }
-}
-
-u32 Entry::hash() const {
-    return hash_;
+Score Entry::static_eval() const {
+    return static_eval_;
 }
 
 Move Entry::move() const {
@@ -56,10 +132,20 @@ Ply Entry::depth() const {
 }
 
 Bound Entry::bound() const {
-    return bound_;
+    return gen_bound_ & 0b11;
 }
 
-Score Entry::to_tt_score(Score score, Ply ply) const {
+u8 Entry::generation() const {
+    return gen_bound_ >> 2;
+}
+
+Entry Entry::with_generation(u8 generation) const {
+    auto e = *this;
+    e.gen_bound_ = generation << 2 | bound();
+    return e;
+}
+
+Score Entry::to_tt_score(Score score, Ply ply) {
     if (score::is_mate(score)) {
         auto mate_ply = score::mate_distance(score);
         auto depth = mate_ply - ply;
@@ -69,59 +155,366 @@ Score Entry::to_tt_score(Score score, Ply ply) const {
     return score;
 }
 
+u16 fold(u64 data) {
+    return data ^ data >> 16 ^ data >> 32 ^ data >> 48;
+}
+
+// Sets key to the verified key of entry i
+Entry load_entry(const Bucket &b, i32 i, u16 &key) {
+    auto data = b.entries[i].load(std::memory_order_relaxed);
+    key = b.keys[i].load(std::memory_order_relaxed) ^ fold(data);
+    return Entry::from_data(data);
+}
+
+void store_entry(Bucket &b, i32 i, u16 key, Entry e) {
+    b.entries[i].store(e.data(), std::memory_order_relaxed);
+    b.keys[i].store(key ^ fold(e.data()), std::memory_order_relaxed);
+}
+
+// An entry as it is laid out in the bucket, key still folded with the data
+struct Slot {
+    bool operator==(const Slot &) const = default;
+
+    u64 data;
+    u16 key;
+};
+
+Slot load_slot(const Bucket &b, i32 i) {
+    return {b.entries[i].load(std::memory_order_relaxed),
+            b.keys[i].load(std::memory_order_relaxed)};
+}
+
+void store_slot(Bucket &b, i32 i, Slot slot) {
+    b.entries[i].store(slot.data, std::memory_order_relaxed);
+    b.keys[i].store(slot.key, std::memory_order_relaxed);
+}
+
+void release(Bucket *buckets, u64 bytes, Backing backing) {
+    if (!buckets) {
+        return;
+    }
+    if (backing == HugePages1G || backing == HugePages2M ||
+        backing == FileMapping) {
+        munmap(buckets, bytes);
+    } else {
+        std::free(buckets);
+    }
+}
+
+// Calls fn(begin, end) on each of threads chunks of [0, size)
+template<class F>
+void for_each_chunk(u64 size, i32 threads, F fn) {
+    if (threads <= 1) {
+        fn(0, size);
+        return;
+    }
+    std::vector<std::thread> workers;
+    auto chunk = size / threads;
+    for (auto i = 0; i < threads; i++) {
+        auto begin = i * chunk;
+        auto end = i == threads - 1 ? size : begin + chunk;
+        workers.emplace_back(fn, begin, end);
+    }
+    for (auto &worker : workers) {
+        worker.join();
+    }
+}
+
 Tt::Tt() {
     init();
 }
 
-void Tt::clear() {
-    init_buckets();
+Tt::~Tt() {
+    free_buckets();
+}
+
+void Tt::clear(i32 threads) {
+    init_buckets(threads);
 }
 
-// Will clear all entries!
-void Tt::resize(u64 mb) {
-    init(mb);
+void Tt::resize(u64 mb, i32 threads) {
+    auto size = power_two_size(mb);
+    auto alloc = allocate_buckets(size);
+    auto old = buckets_;
+    auto old_size = size_;
+    auto old_bytes = bytes_;
+    auto old_backing = backing_;
+    set_buckets(alloc, size);
+    init_buckets(threads);
+    rehash(old, old_size, threads);
+    release(old, old_bytes, old_backing);
 }
 
-Entry &Tt::find(Hash hash) {
+void Tt::new_search() {
+    generation_ = (generation_ + 1) % GENERATION_CYCLE;
+}
+
+void Tt::prefetch(Hash hash) const {
+    __builtin_prefetch(&get_bucket(hash));
+}
+
+Entry Tt::probe(Hash hash) const {
     auto &b = get_bucket(hash);
-    Entry *entry = nullptr;
-    for (auto &e : b.entries) {
-        if (e.hash() == to_entry_hash(hash)) {
+    for (auto i = 0; i < BUCKET_SIZE; i++) {
+        u16 key;
+        auto e = load_entry(b, i, key);
+        if (e.is_valid() && key == to_entry_key(hash)) {
             return e;
         }
-        if (!entry || e.depth() < entry->depth()) {
-            entry = &e;
+    }
+    return {};
+}
+
+// Replaces the entry of the same position if it is from an older search
+// or not searched deeper. Otherwise replaces the entry with the lowest
+// priority in the bucket, where older entries count as shallower.
+void Tt::store(Hash hash, Move move, Score score, Score static_eval,
+               Ply depth, Bound bound, Ply ply) {
+    auto &b = get_bucket(hash);
+    auto slot = -1;
+    Entry old;
+    u16 old_key;
+    for (auto i = 0; i < BUCKET_SIZE; i++) {
+        u16 key;
+        auto e = load_entry(b, i, key);
+        if (e.is_valid() && key == to_entry_key(hash)) {
+            slot = i;
+            old = e;
+            old_key = key;
+            break;
+        }
+        if (slot == -1 || replace_priority(e) < replace_priority(old)) {
+            slot = i;
+            old = e;
+            old_key = key;
         }
     }
-    entry->invalidate();
-    return *entry;
+    if (!old.is_valid() || old_key != to_entry_key(hash) || age(old) > 0 ||
+        depth >= old.depth()) {
+        auto e = Entry(move, score, static_eval, depth, bound, ply,
+                       generation_);
+        store_entry(b, slot, to_entry_key(hash), e);
+    }
+}
+
+bool Tt::save(const std::string &path) const {
+    std::ofstream file(path, std::ios::binary);
+    auto header = file_header(size_, generation_);
+    auto padding = std::string(FILE_HEADER_BYTES - sizeof(header), '\0');
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(padding.data(), padding.size());
+    file.write(reinterpret_cast<const char *>(buckets_),
+               size_ * sizeof(Bucket));
+    file.flush();
+    return file.good();
+}
+
+bool Tt::load(const std::string &path) {
+    auto fd = open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+        return false;
+    }
+    FileHeader header;
+    struct stat st;
+    auto ok = pread(fd, &header, sizeof(header), 0) == sizeof(header) &&
+              is_compatible(header) && fstat(fd, &st) == 0 &&
+              st.st_size == FILE_HEADER_BYTES + header.size * sizeof(Bucket);
+    auto p = MAP_FAILED;
+    if (ok) {
+        // Private mapping: stores during search never write back to the file
+        p = mmap(nullptr, header.size * sizeof(Bucket), PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE, fd, FILE_HEADER_BYTES);
+    }
+    close(fd);
+    if (p == MAP_FAILED) {
+        return false;
+    }
+    free_buckets();
+    buckets_ = static_cast<Bucket *>(p);
+    size_ = header.size;
+    bytes_ = size_ * sizeof(Bucket);
+    backing_ = FileMapping;
+    generation_ = header.generation;
+    return true;
 }
 
 i32 Tt::hashfull() const {
     i32 cnt = 0;
-    for (auto i = 0; i < 1000; i++) {
-        for (auto e : buckets_[i].entries) {
-            cnt += e.is_valid();
+    for (u64 i = 0; i < HASHFULL_BUCKETS; i++) {
+        for (auto j = 0; j < BUCKET_SIZE; j++) {
+            u16 key;
+            auto e = load_entry(buckets_[i], j, key);
+            cnt += e.is_valid() && age(e) == 0;
         }
     }
     return cnt / BUCKET_SIZE;
 }
 
-void Tt::init_buckets() {
-    buckets_ = std::vector<Bucket>(size_);
+u64 Tt::mb() const {
+    return size_ * sizeof(Bucket) / MB;
+}
+
+Backing Tt::backing() const {
+    return backing_;
+}
+
+// Number of searches since the entry was written
+i32 Tt::age(Entry e) const {
+    return (GENERATION_CYCLE + generation_ - e.generation()) %
+           GENERATION_CYCLE;
+}
+
+// Each search of age is worth 8 plies of depth
+i32 Tt::replace_priority(Entry e) const {
+    if (!e.is_valid()) {
+        return std::numeric_limits<i32>::min();
+    }
+    return e.depth() - 8 * age(e);
+}
+
+// Explicit huge pages only succeed if the admin reserved enough of them
+// (vm.nr_hugepages), so failing here is the common case
+bool Tt::map_huge_pages(u64 size, u64 page_size, u64 flags,
+                        Allocation &alloc) {
+#ifdef MAP_HUGETLB
+    auto bytes = round_up(size * sizeof(Bucket), page_size);
+    auto p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | flags, -1, 0);
+    if (p != MAP_FAILED) {
+        alloc.buckets = static_cast<Bucket *>(p);
+        alloc.bytes = bytes;
+        return true;
+    }
+#endif
+    return false;
+}
+
+// Fall back from 1 GB to 2 MB explicit huge pages, then to
+// regular allocations that the kernel may back with transparent huge pages
+Tt::Allocation Tt::allocate_buckets(u64 size) {
+    Allocation alloc;
+#ifdef MAP_HUGE_SHIFT
+    if (size * sizeof(Bucket) >= GB &&
+        map_huge_pages(size, GB, 30 << MAP_HUGE_SHIFT, alloc)) {
+        alloc.backing = HugePages1G;
+        return alloc;
+    }
+#endif
+    if (map_huge_pages(size, 2 * MB, 0, alloc)) {
+        alloc.backing = HugePages2M;
+        return alloc;
+    }
+    alloc.bytes = round_up(size * sizeof(Bucket), 2 * MB);
+    alloc.buckets =
+        static_cast<Bucket *>(std::aligned_alloc(2 * MB, alloc.bytes));
+    if (!alloc.buckets) {
+        throw std::bad_alloc();
+    }
+    alloc.backing = Heap;
+#ifdef MADV_HUGEPAGE
+    if (madvise(alloc.buckets, alloc.bytes, MADV_HUGEPAGE) == 0) {
+        alloc.backing = TransparentHugePages;
+    }
+#endif
+    return alloc;
+}
+
+void Tt::set_buckets(Allocation alloc, u64 size) {
+    buckets_ = alloc.buckets;
+    size_ = size;
+    bytes_ = alloc.bytes;
+    backing_ = alloc.backing;
+}
+
+void Tt::free_buckets() {
+    release(buckets_, bytes_, backing_);
+    buckets_ = nullptr;
 }
 
-void Tt::set_power_two_size(u64 mb) {
-    size_ = mb * 1024 * 1024 / sizeof(Bucket);
-    size_ = 1_u64 << (63 - std::countl_zero(size_));
+void Tt::init_buckets(u64 begin, u64 end) {
+    std::uninitialized_value_construct_n(buckets_ + begin, end - begin);
 }
 
-void Tt::init(u64 mb) {
-    set_power_two_size(mb);
-    init_buckets();
+void Tt::init_buckets(i32 threads) {
+    for_each_chunk(size_, threads,
+                   [this](u64 begin, u64 end) { init_buckets(begin, end); });
 }
 
-i32 Tt::hash_index(Hash hash) const {
+// The stored key is a part of the hash that hash_index does not use, so
+// the new index of an entry cannot be recomputed. What is known is that
+// an entry in old bucket i belongs in a new bucket whose low bits equal i.
+// When growing, each new bucket gets a copy of its only candidate old
+// bucket. Only one copy of each entry is in the right bucket, and it is
+// not known which, so all copies are aged by half a generation cycle.
+// They then rank below the entries of any recent search and are replaced
+// first, while they can still be probed. When shrinking, each new bucket
+// keeps the entries of highest priority among all of its old buckets.
+void Tt::rehash(const Bucket *old, u64 old_size, u64 begin, u64 end) {
+    auto grown = size_ > old_size;
+    auto copy_generation =
+        (generation_ + GENERATION_CYCLE / 2) % GENERATION_CYCLE;
+    for (auto i = begin; i < end; i++) {
+        if (grown) {
+            auto &b = old[i & (old_size - 1)];
+            for (auto k = 0; k < BUCKET_SIZE; k++) {
+                u16 key;
+                auto e = load_entry(b, k, key);
+                if (e.is_valid()) {
+                    store_entry(buckets_[i], k, key,
+                                e.with_generation(copy_generation));
+                }
+            }
+            continue;
+        }
+        std::array<Slot, BUCKET_SIZE> best{};
+        for (auto j = i & (old_size - 1); j < old_size; j += size_) {
+            for (auto k = 0; k < BUCKET_SIZE; k++) {
+                auto slot = load_slot(old[j], k);
+                auto it = std::find(best.begin(), best.end(), slot);
+                if (it != best.end()) {
+                    continue;  // Same entry copied by an earlier grow
+                }
+                auto e = Entry::from_data(slot.data);
+                auto worst = std::min_element(
+                    best.begin(), best.end(), [this](Slot a, Slot b) {
+                        return replace_priority(Entry::from_data(a.data)) <
+                               replace_priority(Entry::from_data(b.data));
+                    });
+                if (replace_priority(e) >
+                    replace_priority(Entry::from_data(worst->data))) {
+                    *worst = slot;
+                }
+            }
+        }
+        for (auto k = 0; k < BUCKET_SIZE; k++) {
+            store_slot(buckets_[i], k, best[k]);
+        }
+    }
+}
+
+void Tt::rehash(const Bucket *old, u64 old_size, i32 threads) {
+    if (!old) {
+        return;
+    }
+    for_each_chunk(size_, threads, [this, old, old_size](u64 begin, u64 end) {
+        rehash(old, old_size, begin, end);
+    });
+}
+
+u64 Tt::power_two_size(u64 mb) {
+    auto size = mb * 1024 * 1024 / sizeof(Bucket);
+    return 1_u64 << (63 - std::countl_zero(size));
+}
+
+void Tt::init(u64 mb, i32 threads) {
+    auto size = power_two_size(mb);
+    auto alloc = allocate_buckets(size);
+    free_buckets();
+    set_buckets(alloc, size);
+    init_buckets(threads);
+}
+
+u64 Tt::hash_index(Hash hash) const {
     // Must use & because compiler doesn't know size is always
     // a power of 2
     return hash >> 32 & size_ - 1;
@@ -132,4 +525,9 @@ Bucket &Tt::get_bucket(Hash hash) {
     return buckets_[index];
 }
 
+const Bucket &Tt::get_bucket(Hash hash) const {
+    auto index = hash_index(hash);
+    return buckets_[index];
+}
+
 }  // namespace tuna::tt
@@ -2,7 +2,8 @@
 #define TUNA_TT_H
 
 #include <array>
-#include <vector>
+#include <atomic>
+#include <string>
 
 #include "common.h"
 
@@ -14,18 +15,22 @@ enum {
     Exact = Lower | Upper,
 };
 
-class __attribute__((packed)) Entry {
+// Value type. The entry data is copied in and out of the table as a single
+// 64-bit word. Its key is stored next to it in the bucket.
+class Entry {
 public:
-    void invalidate();
+    Entry() = default;  // Invalid entry
+    Entry(Move move, Score score, Score static_eval, Ply depth, Bound bound,
+          Ply ply, u8 generation);
+
+    static Entry from_data(u64 data);
+    u64 data() const;
 
     bool is_valid() const;
 
     Score search_score(Ply ply) const;
 
-    void update(Hash hash, Move move, Score score, Ply depth, Bound bound,
-                Ply ply);
-
-    u32 hash() const;
+    Score static_eval() const;
 
     Move move() const;
 
@@ -33,47 +38,121 @@ public:
 
     Bound bound() const;
 
-private:
-    Score to_tt_score(Score score, Ply ply) const;
+    u8 generation() const;
+    // Same entry, as if written by the search of the given generation
+    Entry with_generation(u8 generation) const;
 
-    u32 hash_;
-    Move move_;
-    Score score_;
-    Ply depth_;  // Will only store non-negative depth
-    Bound bound_;
+private:
+    static Score to_tt_score(Score score, Ply ply);
+
+    Move move_ = move::Null;
+    Score score_ = 0;
+    Score static_eval_ = 0;
+    Ply depth_ = 0;  // Will only store non-negative depth
+    // Low 2 bits: bound, never 0 for a stored entry. High 6 bits: generation
+    u8 gen_bound_ = 0;
 };
 
-static_assert(sizeof(Entry) == 10);
+static_assert(sizeof(Entry) == sizeof(u64));
+
+const auto GENERATION_CYCLE = 1 << 6;
 
 const auto BUCKET_SIZE = 3;
 
+// Keys are stored XORed with a fold of their entry's data. If a probe
+// races with a store and reads the data of one write and the key of
+// another, the key check fails.
 struct alignas(32) Bucket {
-    std::array<Entry, BUCKET_SIZE> entries;
+    std::array<std::atomic<u64>, BUCKET_SIZE> entries;
+    std::array<std::atomic<u16>, BUCKET_SIZE> keys;
 };
 
 static_assert(sizeof(Bucket) == 32);
+static_assert(std::atomic<u64>::is_always_lock_free);
+static_assert(std::atomic<u16>::is_always_lock_free);
+
+// How the table memory is backed
+enum Backing {
+    HugePages1G,  // MAP_HUGETLB with 1 GB pages
+    HugePages2M,  // MAP_HUGETLB with 2 MB pages
+    TransparentHugePages,
+    Heap,
+    FileMapping,  // Loaded from a saved table, copy-on-write
+};
 
+std::string to_str(Backing backing);
+
+// Lockless: probe and store may be called concurrently from any number of
+// threads. A racing store can still overwrite another one, but entries
+// are never torn.
 class Tt {
 public:
     Tt();
-
-    void clear();
-    void resize(u64 mb);
-
-    Entry &find(Hash hash);
-
+    ~Tt();
+
+    Tt(const Tt &) = delete;
+    Tt &operator=(const Tt &) = delete;
+
+    // Zeroing is split across threads, which also spreads the first touch
+    // of each page over the threads that will search with the table
+    void clear(i32 threads = 1);
+    // Keeps as many entries as fit in the new size. Needs memory for both
+    // tables while it runs
+    void resize(u64 mb, i32 threads = 1);
+
+    // Called once per search. Entries from older searches are replaced first
+    void new_search();
+
+    void prefetch(Hash hash) const;
+    Entry probe(Hash hash) const;
+    void store(Hash hash, Move move, Score score, Score static_eval,
+               Ply depth, Bound bound, Ply ply);
+
+    // The file starts with a header recording the table size, generation and
+    // engine version. Load maps the entries straight from the file, so they
+    // are only read from disk when first probed. On failure, the current
+    // table is kept.
+    bool save(const std::string &path) const;
+    bool load(const std::string &path);
+
+    // Permill of entries written by the current search
     i32 hashfull() const;
+    u64 mb() const;
+    Backing backing() const;
 
 private:
-    void init_buckets();
-    void set_power_two_size(u64 mb);
-    void init(u64 mb = 16);
-
-    i32 hash_index(Hash hash) const;
+    i32 age(Entry e) const;
+    i32 replace_priority(Entry e) const;
+
+    struct Allocation {
+        Bucket *buckets;
+        u64 bytes;
+        Backing backing;
+    };
+
+    // Leave the current table untouched, so that a failed allocation can
+    // not leave a null table behind
+    static bool map_huge_pages(u64 size, u64 page_size, u64 flags,
+                               Allocation &alloc);
+    static Allocation allocate_buckets(u64 size);
+    void set_buckets(Allocation alloc, u64 size);
+    void free_buckets();
+    void init_buckets(u64 begin, u64 end);
+    void init_buckets(i32 threads);
+    void rehash(const Bucket *old, u64 old_size, u64 begin, u64 end);
+    void rehash(const Bucket *old, u64 old_size, i32 threads);
+    static u64 power_two_size(u64 mb);
+    void init(u64 mb = 16, i32 threads = 1);
+
+    u64 hash_index(Hash hash) const;
     Bucket &get_bucket(Hash hash);
+    const Bucket &get_bucket(Hash hash) const;
 
-    std::vector<Bucket> buckets_;
+    Bucket *buckets_ = nullptr;
     u64 size_;
+    u64 bytes_;  // Allocated size, rounded up to the page size
+    Backing backing_;
+    u8 generation_ = 0;
 };
 
 }  // namespace tuna::tt
@@ -1,9 +1,11 @@
 #include "uci.h"
 
+#include <algorithm>
 #include <sstream>
 #include <string>
 #include <thread>
 
+#include "bench.h"
 #include "board.h"
 #include "cfg.h"
 #include "common.h"
@@ -15,12 +17,14 @@
 namespace tuna {
 namespace uci_option {
 
-enum { Spin };
+enum { Spin, Check };
 
 std::string to_str(UciOptionType ot) {
     switch (ot) {
     case Spin:
         return "spin";
+    case Check:
+        return "check";
     default:
         unreachable();
     }
@@ -31,7 +35,11 @@ struct Option {
         std::string s;
         s += std::format("option name {} type {}", name,
                          uci_option::to_str(type));
-        s += default_value ? std::format(" default {}", *default_value) : "";
+        if (type == Check) {
+            s += std::format(" default {}", *default_value != 0);
+        } else if (default_value) {
+            s += std::format(" default {}", *default_value);
+        }
         s += min_value ? std::format(" min {}", *min_value) : "";
         s += max_value ? std::format(" max {}", *max_value) : "";
         return s;
@@ -45,7 +53,9 @@ struct Option {
 };
 
 const auto OPTIONS = std::array{
-    Option{"Hash", Spin, 16, 1, std::numeric_limits<u64>::max()},
+    Option{"Hash", Spin, 16, 1, 33554432},
+    Option{"Threads", Spin, 1, 1, 1024},
+    Option{"SearchStats", Check, false},
 };
 
 }  // namespace uci_option
@@ -53,10 +63,10 @@ const auto OPTIONS = std::array{
 namespace uci {
 
 using board::Board;
-using search::Searcher;
+using search::ThreadPool;
 
 Board board;
-Searcher searcher(board);
+ThreadPool pool(board);
 std::thread search_thread;
 std::atomic<bool> quit_requested = false;
 
@@ -86,28 +96,60 @@ void handle_uci() {
     io::println("uciok");
 }
 
+// Spin values outside the declared bounds are clamped to them
+u64 clamp_option(const std::string &name, u64 value) {
+    for (auto &option : uci_option::OPTIONS) {
+        if (option.name == name && option.min_value && option.max_value) {
+            return std::clamp(value, *option.min_value, *option.max_value);
+        }
+    }
+    return value;
+}
+
+// Searchers, the TT and the flags searchers read must not change while a
+// search uses them
+void stop_search() {
+    pool.stop();
+    if (search_thread.joinable()) {
+        search_thread.join();
+    }
+}
+
 void handle_setoption(std::istringstream &iss) {
     std::string token;
     if (iss >> token && token != "name") {
         return;
     }
-    if (!(iss >> token)) {
+    std::string name;
+    if (!(iss >> name)) {
         return;
     }
-    if (token == "Hash") {
-        if (iss >> token && token != "value") {
-            return;
-        }
-        u64 mb;
-        if (!(iss >> mb)) {
-            return;
+    if (iss >> token && token != "value") {
+        return;
+    }
+    if (name == "SearchStats") {
+        if (iss >> token) {
+            stop_search();
+            pool.set_stats_enabled(token == "true");
         }
-        searcher.resize_tt(mb);
+        return;
+    }
+    u64 value;
+    if (!(iss >> value)) {
+        return;
+    }
+    value = clamp_option(name, value);
+    if (name == "Hash") {
+        stop_search();
+        pool.resize_tt(value);
+    } else if (name == "Threads") {
+        stop_search();
+        pool.resize(value);
     }
 }
 
 void handle_ucinewgame() {
-    searcher.new_game();
+    pool.new_game();
 }
 
 void handle_position(std::istringstream &iss) {
@@ -185,19 +227,71 @@ void handle_go(std::istringstream &iss) {
     if (search_thread.joinable()) {
         search_thread.join();
     }
-    search_thread = std::thread([cmd] { searcher.go(cmd); });
+    search_thread = std::thread([cmd] { pool.go(cmd); });
 }
 
 void handle_stop() {
-    searcher.stop();
+    pool.stop();
 }
 
+// Stops a running search, as the table must not be used while it is saved
+// or replaced. Load after ucinewgame, which clears the table
+void handle_hash_file(std::istringstream &iss, bool save) {
+    std::string path;
+    if (!std::getline(iss >> std::ws, path) || path.empty()) {
+        return;
+    }
+    stop_search();
+    if (save) {
+        pool.save_tt(path);
+    } else {
+        pool.load_tt(path);
+    }
+}
+
+// perft <depth> [hash [mb]]. Runs with the Threads option. With hash,
+// subtree counts are cached in a perft table of the given size, shared by
+// all threads
 void handle_perft(std::istringstream &iss) {
+    i32 depth;
+    if (!(iss >> depth) || depth < 1) {
+        return;
+    }
+    std::string token;
+    if (!(iss >> token) || token != "hash") {
+        movegen::perft_parallel(board, depth, pool.threads());
+        return;
+    }
+    u64 mb;
+    if (!(iss >> mb)) {
+        mb = cfg::PERFT_HASH_MB;
+    }
+    movegen::PerftTable table(mb);
+    movegen::perft_parallel(board, depth, pool.threads(), &table);
+}
+
+// bench [depth] [hash] [threads]. Stops a running search, then searches
+// with its own TT and threads, so the Hash and Threads options are left
+// alone. Statistics are summarized at the end when SearchStats is on
+void handle_bench(std::istringstream &iss) {
     i32 depth;
     if (!(iss >> depth)) {
+        depth = cfg::BENCH_DEPTH;
+    }
+    u64 mb;
+    if (!(iss >> mb)) {
+        mb = cfg::BENCH_HASH_MB;
+    }
+    mb = clamp_option("Hash", mb);
+    i32 threads;
+    if (!(iss >> threads)) {
+        threads = 1;
+    }
+    if (depth < 1 || depth > PLY_MAX || mb < 1 || threads < 1) {
         return;
     }
-    movegen::perft(board, depth);
+    stop_search();
+    bench::run(depth, mb, threads, pool.stats_enabled());
 }
 
 void handle_board() {
@@ -208,9 +302,8 @@ void handle_eval() {
     io::println("{}", eval::evaluate(board));
 }
 
-void handle_command() {
+void handle_command(std::istringstream &iss) {
     std::string token;
-    auto iss = get_input();
     iss >> token;
     if (token == "uci") {
         handle_uci();
@@ -226,6 +319,12 @@ void handle_command() {
         handle_go(iss);
     } else if (token == "stop") {
         handle_stop();
+    } else if (token == "savehash") {
+        handle_hash_file(iss, true);
+    } else if (token == "loadhash") {
+        handle_hash_file(iss, false);
+    } else if (token == "bench") {
+        handle_bench(iss);
     } else if (token == "quit") {
         quit_requested = true;
     } else if (cfg::DEVEL) {
@@ -242,8 +341,23 @@ void handle_command() {
 i32 run_loop() {
     init();
     while (!quit_requested) {
-        handle_command();
+        auto iss = get_input();
+        handle_command(iss);
+    }
+    if (search_thread.joinable()) {
+        search_thread.join();
+    }
+    return 0;
+}
+
+i32 run_args(i32 argc, char **argv) {
+    init();
+    std::string command;
+    for (auto i = 1; i < argc; i++) {
+        command += std::format("{} ", argv[i]);
     }
+    std::istringstream iss(command);
+    handle_command(iss);
     if (search_thread.joinable()) {
         search_thread.join();
     }
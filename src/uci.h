@@ -6,6 +6,8 @@
 namespace tuna::uci {
 
 i32 run_loop();
+// Runs the command line arguments as a single command, e.g. tuna bench
+i32 run_args(i32 argc, char **argv);
 
 }
 
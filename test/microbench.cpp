@@ -0,0 +1,199 @@
+// Times the primitives on the search hot path over the bench positions.
+// Usage: tuna_microbench [--benchmark_format=json] [--benchmark_out=<file>]
+// Two JSON outputs can be compared with tools/compare.py from Google
+// Benchmark.
+#include <benchmark/benchmark.h>
+
+#include <array>
+#include <random>
+#include <vector>
+
+#include "bench.h"
+#include "board.h"
+#include "common.h"
+#include "eval.h"
+#include "hash.h"
+#include "lookup.h"
+#include "movegen.h"
+#include "movepick.h"
+#include "search.h"
+#include "tt.h"
+
+namespace tuna::microbench {
+
+using board::Board;
+using movegen::MoveGenerator;
+using movegen::MoveList;
+
+struct Position {
+    Board board;
+    MoveList moves;  // Legal moves
+};
+
+void init() {
+    hash::init();
+    lookup::init();
+    search::init();
+}
+
+std::vector<Position> &corpus() {
+    static auto positions = [] {
+        std::vector<Position> positions;
+        for (auto fen : bench::positions()) {
+            Position pos;
+            pos.board.setup_fen(fen);
+            MoveGenerator gen(pos.board);
+            gen.generate_all();
+            pos.moves = gen.moves();
+            positions.push_back(pos);
+        }
+        return positions;
+    }();
+    return positions;
+}
+
+void make_unmake(benchmark::State &state) {
+    auto &positions = corpus();
+    i64 moves = 0;
+    for (auto _ : state) {
+        for (auto &pos : positions) {
+            for (auto move : pos.moves) {
+                pos.board.make_move(move);
+                pos.board.unmake_move();
+            }
+            moves += pos.moves.size();
+        }
+    }
+    state.SetItemsProcessed(moves);
+}
+BENCHMARK(make_unmake);
+
+// Only positions not in check, as evasions are generated on their own
+void generate(benchmark::State &state) {
+    auto type = static_cast<movegen::Type>(state.range(0));
+    auto &positions = corpus();
+    i64 calls = 0;
+    for (auto _ : state) {
+        for (auto &pos : positions) {
+            if (pos.board.in_check()) {
+                continue;
+            }
+            MoveGenerator gen(pos.board);
+            gen.generate(type);
+            benchmark::DoNotOptimize(gen.moves().size());
+            calls++;
+        }
+    }
+    state.SetItemsProcessed(calls);
+}
+BENCHMARK(generate)
+    ->ArgName("type")
+    ->Arg(movegen::Captures)
+    ->Arg(movegen::Quiets);
+
+// Move ordering cost per node: picking stops after the given number of
+// moves, as most nodes cut off early. Random history scores make the
+// quiets come out in a realistic, unsorted order
+void move_picker(benchmark::State &state) {
+    using movepick::MovePicker;
+    auto picked = state.range(0);
+    auto &positions = corpus();
+    auto rng = std::mt19937_64();
+    ButterflyHistory hist;
+    for (auto &by_color : hist) {
+        for (auto &by_from : by_color) {
+            for (auto &score : by_from) {
+                score = static_cast<i32>(rng() % (2 * HISTORY_MAX + 1)) -
+                        HISTORY_MAX;
+            }
+        }
+    }
+    std::array<Move, cfg::KILLERS_COUNT> killers{};
+    i64 nodes = 0;
+    for (auto _ : state) {
+        for (auto &pos : positions) {
+            MovePicker mp(pos.board, movepick::Main, move::Null, killers,
+                          hist);
+            auto cnt = 0;
+            for (auto move : mp) {
+                benchmark::DoNotOptimize(move);
+                if (++cnt == picked) {
+                    break;
+                }
+            }
+        }
+        nodes += positions.size();
+    }
+    state.SetItemsProcessed(nodes);
+}
+BENCHMARK(move_picker)->ArgName("picked")->Arg(1)->Arg(4)->Arg(256);
+
+void evaluate(benchmark::State &state) {
+    auto &positions = corpus();
+    i64 calls = 0;
+    for (auto _ : state) {
+        for (auto &pos : positions) {
+            benchmark::DoNotOptimize(eval::evaluate(pos.board));
+        }
+        calls += positions.size();
+    }
+    state.SetItemsProcessed(calls);
+}
+BENCHMARK(evaluate);
+
+// Random keys over the whole table, so that larger tables also measure
+// cache and TLB misses. Half of the keys are stored
+void tt_probe(benchmark::State &state) {
+    tt::Tt tt;
+    tt.resize(state.range(0));
+    auto rng = std::mt19937_64();
+    std::vector<Hash> hashes(1 << 16);
+    for (auto &hash : hashes) {
+        hash = rng();
+    }
+    for (auto i = 0; i < hashes.size(); i += 2) {
+        tt.store(hashes[i], move::Null, 0, 0, 1, tt::Exact, 0);
+    }
+    i64 probes = 0;
+    for (auto _ : state) {
+        for (auto hash : hashes) {
+            benchmark::DoNotOptimize(tt.probe(hash));
+        }
+        probes += hashes.size();
+    }
+    state.SetItemsProcessed(probes);
+}
+BENCHMARK(tt_probe)->ArgName("mb")->Arg(16)->Arg(256);
+
+// Every square against the occupancy of each position
+void attacks(benchmark::State &state) {
+    auto pc = static_cast<Piece>(state.range(0));
+    auto &positions = corpus();
+    i64 calls = 0;
+    for (auto _ : state) {
+        for (auto &pos : positions) {
+            auto occ = pos.board.all();
+            for (Square sq = 0; sq < 64; sq++) {
+                benchmark::DoNotOptimize(lookup::attacks(pc, sq, occ));
+            }
+        }
+        calls += positions.size() * 64;
+    }
+    state.SetItemsProcessed(calls);
+}
+BENCHMARK(attacks)
+    ->ArgName("piece")
+    ->Arg(piece::Knight)
+    ->Arg(piece::Bishop)
+    ->Arg(piece::Rook)
+    ->Arg(piece::Queen);
+
+}  // namespace tuna::microbench
+
+int main(int argc, char **argv) {
+    tuna::microbench::init();
+    benchmark::Initialize(&argc, argv);
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -67,6 +67,162 @@ TEST_F(MovegenTest, BasicPerft6) {
     // clang-format on
 }
 
+// Positions targeting pins, checks and special moves, which the legal
+// move generator has to get right without Board::is_legal
+
+TEST_F(MovegenTest, LegalPerft1) {
+    // Ep capture would expose the king along the rank
+    // clang-format off
+    board.setup_fen("3k4/3p4/8/K1P4r/8/8/8/8 b - - 0 1");
+    EXPECT_EQ(perft(board, 6), 1'134'888);
+    // clang-format on
+}
+
+TEST_F(MovegenTest, LegalPerft2) {
+    // Ep capture by a pawn pinned on a diagonal
+    // clang-format off
+    board.setup_fen("8/8/4k3/8/2p5/8/B2P2K1/8 w - - 0 1");
+    EXPECT_EQ(perft(board, 6), 1'015'133);
+    // clang-format on
+}
+
+TEST_F(MovegenTest, LegalPerft3) {
+    // Ep capture that gives check
+    // clang-format off
+    board.setup_fen("8/8/1k6/2b5/2pP4/8/5K2/8 b - d3 0 1");
+    EXPECT_EQ(perft(board, 6), 1'440'467);
+    // clang-format on
+}
+
+TEST_F(MovegenTest, LegalPerft4) {
+    // Short castling gives check
+    // clang-format off
+    board.setup_fen("5k2/8/8/8/8/8/8/4K2R w K - 0 1");
+    EXPECT_EQ(perft(board, 6), 661'072);
+    // clang-format on
+}
+
+TEST_F(MovegenTest, LegalPerft5) {
+    // Long castling gives check
+    // clang-format off
+    board.setup_fen("3k4/8/8/8/8/8/8/R3K3 w Q - 0 1");
+    EXPECT_EQ(perft(board, 6), 803'711);
+    // clang-format on
+}
+
+TEST_F(MovegenTest, LegalPerft6) {
+    // Castling rights lost by capturing rooks
+    // clang-format off
+    board.setup_fen("r3k2r/1b4bq/8/8/8/8/7B/R3K2R w KQkq - 0 1");
+    EXPECT_EQ(perft(board, 4), 1'274'206);
+    // clang-format on
+}
+
+TEST_F(MovegenTest, LegalPerft7) {
+    // Castling through attacked squares
+    // clang-format off
+    board.setup_fen("r3k2r/8/3Q4/8/8/5q2/8/R3K2R b KQkq - 0 1");
+    EXPECT_EQ(perft(board, 4), 1'720'476);
+    // clang-format on
+}
+
+TEST_F(MovegenTest, LegalPerft8) {
+    // Promotion out of check
+    // clang-format off
+    board.setup_fen("2K2r2/4P3/8/8/8/8/8/3k4 w - - 0 1");
+    EXPECT_EQ(perft(board, 6), 3'821'001);
+    // clang-format on
+}
+
+TEST_F(MovegenTest, LegalPerft9) {
+    // Discovered check
+    // clang-format off
+    board.setup_fen("8/8/1P2K3/8/2n5/1q6/8/5k2 b - - 0 1");
+    EXPECT_EQ(perft(board, 5), 1'004'658);
+    // clang-format on
+}
+
+TEST_F(MovegenTest, LegalPerft10) {
+    // Promotion that gives check
+    // clang-format off
+    board.setup_fen("4k3/1P6/8/8/8/8/K7/8 w - - 0 1");
+    EXPECT_EQ(perft(board, 6), 217'342);
+    // clang-format on
+}
+
+TEST_F(MovegenTest, LegalPerft11) {
+    // Underpromotion that gives check
+    // clang-format off
+    board.setup_fen("8/P1k5/K7/8/8/8/8/8 w - - 0 1");
+    EXPECT_EQ(perft(board, 6), 92'683);
+    // clang-format on
+}
+
+TEST_F(MovegenTest, LegalPerft12) {
+    // Self stalemate
+    // clang-format off
+    board.setup_fen("K1k5/8/P7/8/8/8/8/8 w - - 0 1");
+    EXPECT_EQ(perft(board, 6), 2'217);
+    // clang-format on
+}
+
+TEST_F(MovegenTest, LegalPerft13) {
+    // Stalemate and checkmate
+    // clang-format off
+    board.setup_fen("8/k1P5/8/1K6/8/8/8/8 w - - 0 1");
+    EXPECT_EQ(perft(board, 7), 567'584);
+    // clang-format on
+}
+
+TEST_F(MovegenTest, LegalPerft14) {
+    // Double check
+    // clang-format off
+    board.setup_fen("8/8/2k5/5q2/5n2/8/5K2/8 b - - 0 1");
+    EXPECT_EQ(perft(board, 4), 23'527);
+    // clang-format on
+}
+
+TEST_F(MovegenTest, HashedPerft1) {
+    // clang-format off
+    board.setup_fen("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1");
+    PerftTable table(16);
+    EXPECT_EQ(perft(board, 6, true, &table), 119'060'324);
+    // clang-format on
+}
+
+TEST_F(MovegenTest, HashedPerft2) {
+    // clang-format off
+    board.setup_fen("r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq -");
+    PerftTable table(16);
+    EXPECT_EQ(perft(board, 5, true, &table), 193'690'690);
+    // clang-format on
+}
+
+TEST_F(MovegenTest, HashedPerft3) {
+    // Tiny table, so most stores overwrite each other
+    // clang-format off
+    board.setup_fen("8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - -");
+    PerftTable table(1);
+    EXPECT_EQ(perft(board, 7, true, &table), 178'633'661);
+    // clang-format on
+}
+
+TEST_F(MovegenTest, ParallelPerft1) {
+    // clang-format off
+    board.setup_fen("r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq -");
+    EXPECT_EQ(perft_parallel(board, 4, 4), 4'085'603);
+    // clang-format on
+}
+
+TEST_F(MovegenTest, ParallelPerft2) {
+    // All threads share one table
+    // clang-format off
+    board.setup_fen("r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1");
+    PerftTable table(16);
+    EXPECT_EQ(perft_parallel(board, 5, 4, &table), 15'833'292);
+    // clang-format on
+}
+
 // Skipping MovegenTest.PseudoLegalPerft* because it takes too long for CI/CD.
 
 TEST_F(MovegenTest, PseudoLegalPerft1) {
@@ -116,3 +272,46 @@ TEST_F(MovegenTest, PseudoLegalPerft6) {
     EXPECT_EQ(perft_pseudo_legal(board, 5), 164'075'551);
     // clang-format on
 }
+
+// Shallow runs over positions full of ep, castling and promotion moves, which
+// is_pseudo_legal checks without generating moves
+
+TEST_F(MovegenTest, PseudoLegalSpecialPerft1) {
+    // Ep capture would expose the king along the rank
+    // clang-format off
+    board.setup_fen("3k4/3p4/8/K1P4r/8/8/8/8 b - - 0 1");
+    EXPECT_EQ(perft_pseudo_legal(board, 4), 10'138);
+    // clang-format on
+}
+
+TEST_F(MovegenTest, PseudoLegalSpecialPerft2) {
+    // Ep capture that gives check, and ep out of check
+    // clang-format off
+    board.setup_fen("8/8/1k6/2b5/2pP4/8/5K2/8 b - d3 0 1");
+    EXPECT_EQ(perft_pseudo_legal(board, 4), 13'931);
+    // clang-format on
+}
+
+TEST_F(MovegenTest, PseudoLegalSpecialPerft3) {
+    // Castling through attacked squares
+    // clang-format off
+    board.setup_fen("r3k2r/8/3Q4/8/8/5q2/8/R3K2R b KQkq - 0 1");
+    EXPECT_EQ(perft_pseudo_legal(board, 3), 50'509);
+    // clang-format on
+}
+
+TEST_F(MovegenTest, PseudoLegalSpecialPerft4) {
+    // Promotions and promotion captures for both sides
+    // clang-format off
+    board.setup_fen("r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1");
+    EXPECT_EQ(perft_pseudo_legal(board, 3), 9'467);
+    // clang-format on
+}
+
+TEST_F(MovegenTest, PseudoLegalSpecialPerft5) {
+    // Kiwipete
+    // clang-format off
+    board.setup_fen("r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq -");
+    EXPECT_EQ(perft_pseudo_legal(board, 3), 97'862);
+    // clang-format on
+}
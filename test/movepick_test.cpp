@@ -0,0 +1,118 @@
+#include "movepick.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdlib>
+
+#include <array>
+#include <atomic>
+#include <new>
+#include <vector>
+
+#include "board.h"
+#include "hash.h"
+#include "lookup.h"
+#include "perf.h"
+#include "search.h"
+
+using namespace tuna;
+using namespace tuna::movepick;
+
+// Allocation-counting hook: every heap allocation in this test binary goes
+// through here
+std::atomic<u64> allocations = 0;
+
+void *operator new(std::size_t size) {
+    allocations++;
+    if (auto p = std::malloc(size)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void *p, [[maybe_unused]] std::size_t size) noexcept {
+    std::free(p);
+}
+
+void init() {
+    hash::init();
+    lookup::init();
+    search::init();
+}
+
+class MovepickTest : public testing::Test {
+protected:
+    static void SetUpTestSuite() {
+        init();
+        // A thread allocates its perf counters on the first record, which
+        // must not be counted as picking
+        perf::record(perf::MoveGenerations);
+    }
+
+    // Number of moves picked and heap allocations made while picking
+    std::pair<i32, u64> pick_all(Type type) {
+        auto start = allocations.load();
+        auto cnt = 0;
+        MovePicker mp(board, type, move::Null, killers, hist);
+        for ([[maybe_unused]] auto move : mp) {
+            cnt++;
+        }
+        return {cnt, allocations - start};
+    }
+
+    board::Board board;
+    std::array<Move, cfg::KILLERS_COUNT> killers{};
+    ButterflyHistory hist{};
+};
+
+TEST_F(MovepickTest, PickingNeverAllocates) {
+    // clang-format off
+    const auto FENS = std::array{
+        "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+        "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq -",
+        "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+        "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+    };
+    const auto MOVE_CNTS = std::array{20, 48, 44, 6};
+    // clang-format on
+    for (auto i = 0; i < FENS.size(); i++) {
+        board.setup_fen(FENS[i]);
+        auto [main_cnt, main_allocs] = pick_all(Main);
+        EXPECT_EQ(main_cnt, MOVE_CNTS[i]);
+        EXPECT_EQ(main_allocs, 0);
+        auto [qsearch_cnt, qsearch_allocs] = pick_all(Qsearch);
+        EXPECT_LE(qsearch_cnt, main_cnt);
+        EXPECT_EQ(qsearch_allocs, 0);
+    }
+}
+
+TEST_F(MovepickTest, LosingCapturesComeAfterQuiets) {
+    // Qxe5 loses the queen for a pawn, Rxa5 wins a pawn
+    board.setup_fen("4k3/8/3p4/p3p3/8/8/8/R3QK2 w - - 0 1");
+    MovePicker mp(board, Main, move::Null, killers, hist);
+    std::vector<Move> moves;
+    for (auto move : mp) {
+        moves.push_back(move);
+    }
+    ASSERT_GE(moves.size(), 3);
+    EXPECT_EQ(moves.front(), move::from_str("a1a5"));
+    EXPECT_EQ(moves.back(), move::from_str("e1e5"));
+}
+
+TEST_F(MovepickTest, SkippingQuietsOnlyKeepsKillers) {
+    board.setup_fen("4k3/8/3p4/p3p3/8/8/8/R3QK2 w - - 0 1");
+    killers = {move::from_str("f1f2"), move::Null};
+    MovePicker mp(board, Main, move::Null, killers, hist);
+    std::vector<Move> moves;
+    for (auto move : mp) {
+        moves.push_back(move);
+        mp.skip_quiet_moves();
+    }
+    // Qxa5 and the losing Qxe5 are skipped after Rxa5
+    auto expected = std::vector{move::from_str("a1a5"), move::from_str("f1f2")};
+    EXPECT_EQ(moves, expected);
+}
@@ -0,0 +1,168 @@
+// Runs every position of an EPD perft suite and checks the node count at
+// each depth. Usage: perft_suite <epd> [max depth] [threads]
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "board.h"
+#include "common.h"
+#include "hash.h"
+#include "io.h"
+#include "lookup.h"
+#include "movegen.h"
+#include "search.h"
+
+namespace tuna::perft_suite {
+
+using board::Board;
+using clock = std::chrono::steady_clock;
+
+struct Position {
+    std::string fen;
+    // expected[d - 1] is the node count at depth d
+    std::vector<u64> expected;
+};
+
+struct Result {
+    bool passed = true;
+    i32 failed_depth = 0;
+    u64 got = 0;
+    u64 nodes = 0;
+    i64 millis = 0;
+};
+
+void init() {
+    hash::init();
+    lookup::init();
+    search::init();
+}
+
+// <fen> ;D1 <nodes> ;D2 <nodes> ...
+bool parse_line(const std::string &line, Position &pos) {
+    std::istringstream iss(line);
+    if (!std::getline(iss, pos.fen, ';')) {
+        return false;
+    }
+    pos.fen.erase(pos.fen.find_last_not_of(' ') + 1);
+    std::string field;
+    while (std::getline(iss, field, ';')) {
+        std::istringstream fss(field);
+        std::string depth;
+        u64 nodes;
+        if (!(fss >> depth >> nodes) || depth[0] != 'D') {
+            return false;
+        }
+        pos.expected.push_back(nodes);
+    }
+    return !pos.fen.empty() && !pos.expected.empty();
+}
+
+bool load_suite(const std::string &path, std::vector<Position> &suite) {
+    std::ifstream file(path);
+    if (!file) {
+        io::println("Cannot open {}", path);
+        return false;
+    }
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        Position pos;
+        if (!parse_line(line, pos)) {
+            io::println("Bad line: {}", line);
+            return false;
+        }
+        suite.push_back(pos);
+    }
+    return true;
+}
+
+Result run(const Position &pos, i32 max_depth) {
+    Result result;
+    auto start = clock::now();
+    Board board;
+    board.setup_fen(pos.fen);
+    auto depths = std::min<i32>(pos.expected.size(), max_depth);
+    for (auto depth = 1; depth <= depths; depth++) {
+        auto nodes = movegen::perft(board, depth, false);
+        result.nodes += nodes;
+        if (nodes != pos.expected[depth - 1]) {
+            result.passed = false;
+            result.failed_depth = depth;
+            result.got = nodes;
+            break;
+        }
+    }
+    result.millis = std::chrono::duration_cast<std::chrono::milliseconds>(
+                        clock::now() - start)
+                        .count();
+    return result;
+}
+
+i32 run_suite(i32 argc, char **argv) {
+    if (argc < 2) {
+        io::println("Usage: perft_suite <epd> [max depth] [threads]");
+        return 1;
+    }
+    auto max_depth = argc > 2 ? std::stoi(argv[2]) : 64;
+    i32 threads = std::thread::hardware_concurrency();
+    threads = argc > 3 ? std::stoi(argv[3]) : std::max(threads, 1);
+    init();
+    std::vector<Position> suite;
+    if (!load_suite(argv[1], suite)) {
+        return 1;
+    }
+
+    auto start = clock::now();
+    std::vector<Result> results(suite.size());
+    std::atomic<i32> next = 0;
+    auto work = [&] {
+        for (auto i = next++; i < suite.size(); i = next++) {
+            results[i] = run(suite[i], max_depth);
+        }
+    };
+    std::vector<std::thread> workers;
+    for (auto i = 0; i < threads; i++) {
+        workers.emplace_back(work);
+    }
+    for (auto &worker : workers) {
+        worker.join();
+    }
+    auto millis = std::chrono::duration_cast<std::chrono::milliseconds>(
+                      clock::now() - start)
+                      .count();
+
+    auto passed = 0;
+    u64 nodes = 0;
+    for (auto i = 0; i < suite.size(); i++) {
+        auto &pos = suite[i];
+        auto &result = results[i];
+        nodes += result.nodes;
+        if (result.passed) {
+            passed++;
+            io::println("PASS {:>6} ms  {}", result.millis, pos.fen);
+        } else {
+            auto depth = result.failed_depth;
+            io::println("FAIL {:>6} ms  {}  D{} expected {} got {}",
+                        result.millis, pos.fen, depth,
+                        pos.expected[depth - 1], result.got);
+        }
+    }
+    io::println("");
+    io::println("{}/{} passed", passed, suite.size());
+    io::println("Nodes: {}, time: {} ms, {} nps, {} threads", nodes, millis,
+                nodes * 1000 / std::max<i64>(millis, 1), threads);
+    return passed == suite.size() ? 0 : 1;
+}
+
+}  // namespace tuna::perft_suite
+
+int main(int argc, char **argv) {
+    return tuna::perft_suite::run_suite(argc, argv);
+}
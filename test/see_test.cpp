@@ -0,0 +1,74 @@
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include "board.h"
+#include "hash.h"
+#include "lookup.h"
+
+using namespace tuna;
+using board::Board;
+using board::SEE_VALUE;
+
+const auto P = SEE_VALUE[piece::Pawn];
+const auto N = SEE_VALUE[piece::Knight];
+const auto B = SEE_VALUE[piece::Bishop];
+const auto R = SEE_VALUE[piece::Rook];
+const auto Q = SEE_VALUE[piece::Queen];
+
+class SeeTest : public testing::Test {
+protected:
+    static void SetUpTestSuite() {
+        hash::init();
+        lookup::init();
+    }
+
+    // value is the exact outcome of the exchange
+    void expect_see(std::string fen, std::string move, i32 value) {
+        board = Board();
+        board.setup_fen(fen);
+        auto m = move::from_str(move);
+        EXPECT_TRUE(board.see(m, value)) << fen << ' ' << move;
+        EXPECT_FALSE(board.see(m, value + 1)) << fen << ' ' << move;
+    }
+
+    Board board;
+};
+
+TEST_F(SeeTest, UndefendedPawn) {
+    expect_see("1k1r4/1pp4p/p7/4p3/8/P5P1/1PP4P/2K1R3 w - - 0 1", "e1e5", P);
+}
+
+TEST_F(SeeTest, QueenTakesDefendedPawn) {
+    expect_see("4k3/8/3p4/4p3/8/8/8/4QK2 w - - 0 1", "e1e5", P - Q);
+}
+
+TEST_F(SeeTest, RookXrayThroughRook) {
+    // The rook on e1 recaptures once the rook on e2 has left
+    expect_see("4k3/4r3/8/4p3/8/8/4R3/4R1K1 w - - 0 1", "e2e5", P);
+    expect_see("4k3/4r3/8/4p3/8/8/4R3/6K1 w - - 0 1", "e2e5", P - R);
+}
+
+TEST_F(SeeTest, QueenXrayThroughBishop) {
+    expect_see("4k3/3n4/8/4p3/8/2B5/1Q6/4K3 w - - 0 1", "c3e5", P - B + N);
+    expect_see("4k3/3n4/8/4p3/8/2B5/8/4K3 w - - 0 1", "c3e5", P - B);
+}
+
+TEST_F(SeeTest, KingRecapturesOnlyUndefendedSquare) {
+    expect_see("8/8/5k2/4p3/8/8/8/K3R3 w - - 0 1", "e1e5", P - R);
+    expect_see("8/8/5k2/R3p3/8/8/8/K3R3 w - - 0 1", "e1e5", P);
+}
+
+TEST_F(SeeTest, QuietMoveHangingPiece) {
+    expect_see("4k3/8/8/3p4/8/8/5N2/4K3 w - - 0 1", "f2e4", -N);
+}
+
+TEST_F(SeeTest, XraysOnBothSides) {
+    // NxP NxN. White stops there, as RxN BxR QxB QxQ would lose more
+    expect_see("1k1r3q/1ppn3p/p4b2/4p3/8/P2N2P1/1PP1R1BP/2K1Q3 w - - 0 1",
+               "d3e5", P - N);
+}
+
+TEST_F(SeeTest, PromotionIsEven) {
+    expect_see("4k3/P7/8/8/8/8/8/4K3 w - - 0 1", "a7a8q", 0);
+}
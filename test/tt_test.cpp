@@ -0,0 +1,359 @@
+#include "tt.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <new>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "board.h"
+#include "hash.h"
+#include "lookup.h"
+#include "movegen.h"
+#include "movepick.h"
+#include "search.h"
+
+using namespace tuna;
+using namespace tuna::tt;
+
+void init() {
+    hash::init();
+    lookup::init();
+    search::init();
+}
+
+const auto THREADS = 8;
+
+class TtTest : public testing::Test {
+protected:
+    // Lookup tables must only be initialized once per process
+    static void SetUpTestSuite() {
+        init();
+    }
+
+    TtTest() {
+        tt.resize(1);  // Small table to maximize contention
+    }
+
+    Tt tt;
+};
+
+// Keys that differ in their low 16 bits, so a probe can only ever match an
+// entry that was stored for the very same hash
+Hash unique_key(u16 i) {
+    auto rng = std::mt19937_64(i);
+    return (rng() & ~0xFFFF_u64) | i;
+}
+
+Move move_for(Hash hash) {
+    return hash >> 20 & 0xFFF;
+}
+
+Score score_for(Hash hash) {
+    return static_cast<Score>(hash >> 40 & 0x3FF);
+}
+
+TEST_F(TtTest, ConcurrentProbeAndStoreNeverTears) {
+    std::atomic<u64> torn = 0;
+    std::atomic<u64> hits = 0;
+    std::vector<std::thread> threads;
+    for (auto t = 0; t < THREADS; t++) {
+        threads.emplace_back([this, t, &torn, &hits] {
+            auto rng = std::mt19937(t);
+            for (auto i = 0; i < 1'000'000; i++) {
+                auto hash = unique_key(rng());
+                if (i % 2 == 0) {
+                    tt.store(hash, move_for(hash), score_for(hash),
+                             -score_for(hash), rng() % 64, Exact, 0);
+                    continue;
+                }
+                auto e = tt.probe(hash);
+                if (!e.is_valid()) {
+                    continue;
+                }
+                hits++;
+                if (e.move() != move_for(hash) ||
+                    e.search_score(0) != score_for(hash) ||
+                    e.static_eval() != -score_for(hash) ||
+                    e.bound() != Exact) {
+                    torn++;
+                }
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    EXPECT_GT(hits, 0);
+    EXPECT_EQ(torn, 0);
+}
+
+std::vector<Move> legal_moves(const board::Board &board) {
+    using movegen::MoveGenerator;
+    MoveGenerator gen(board);
+    std::vector<Move> moves;
+    auto add_moves = [&](movegen::Type type) {
+        gen.generate(type);
+        moves.insert(moves.end(), gen.moves().begin(), gen.moves().end());
+    };
+    if (board.in_check()) {
+        add_moves(movegen::Evasions);
+    } else {
+        add_moves(movegen::Captures);
+        add_moves(movegen::Quiets);
+    }
+    return moves;
+}
+
+// Threads play random games on their own boards while sharing one table.
+// Whatever the table returns for a position, MovePicker must only ever
+// yield legal moves of that position.
+TEST_F(TtTest, ConcurrentTtMovesNeverReachMovePickerCorrupt) {
+    std::atomic<u64> illegal = 0;
+    std::vector<std::thread> threads;
+    for (auto t = 0; t < THREADS; t++) {
+        threads.emplace_back([this, t, &illegal] {
+            auto rng = std::mt19937(t);
+            auto board = board::Board();
+            ButterflyHistory hist{};
+            std::array<Move, cfg::KILLERS_COUNT> killers{};
+            for (auto ply = 0; ply < 20'000; ply++) {
+                auto moves = legal_moves(board);
+                if (moves.empty() || board.is_draw() || ply % 200 == 0) {
+                    board = board::Board();
+                    continue;
+                }
+                auto e = tt.probe(board.hash());
+                auto ttm = e.is_valid() ? e.move() : move::Null;
+                movepick::MovePicker mp(board, movepick::Main, ttm, killers,
+                                        hist);
+                for (auto move : mp) {
+                    if (std::find(moves.begin(), moves.end(), move) ==
+                        moves.end()) {
+                        illegal++;
+                    }
+                }
+                auto move = moves[rng() % moves.size()];
+                tt.store(board.hash(), move, 0, 0, 1, Exact, 0);
+                board.make_move(move);
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    EXPECT_EQ(illegal, 0);
+}
+
+// Average probe hit rate over the last half of a simulated 100-move game.
+// Every move stores a fresh set of keys, a quarter of them deep, and then
+// probes them again. Without aging, deep entries from earlier moves keep
+// their slots and crowd out the current search.
+f64 game_hit_rate(Tt &tt, bool new_search_per_move) {
+    const auto KEYS_PER_MOVE = 20'000;
+    auto rng = std::mt19937_64(0);
+    f64 hit_rate = 0;
+    for (auto move = 0; move < 100; move++) {
+        if (new_search_per_move) {
+            tt.new_search();
+        }
+        std::vector<Hash> keys(KEYS_PER_MOVE);
+        for (auto &key : keys) {
+            key = rng();
+            auto depth = rng() % 4 == 0 ? 20 : 1 + rng() % 4;
+            tt.store(key, move::Null, 0, 0, depth, Exact, 0);
+        }
+        auto hits = 0;
+        for (auto key : keys) {
+            hits += tt.probe(key).is_valid();
+        }
+        if (move >= 50) {
+            hit_rate += static_cast<f64>(hits) / KEYS_PER_MOVE / 50;
+        }
+    }
+    return hit_rate;
+}
+
+TEST_F(TtTest, AgingKeepsHitRateOverLongGame) {
+    auto aged = game_hit_rate(tt, true);
+    tt.clear();
+    auto unaged = game_hit_rate(tt, false);
+    EXPECT_GT(aged, 0.9);
+    EXPECT_GT(aged, unaged);
+}
+
+TEST_F(TtTest, HashfullOnlyCountsCurrentSearch) {
+    auto rng = std::mt19937_64(0);
+    for (auto i = 0; i < 100'000; i++) {
+        tt.store(rng(), move::Null, 0, 0, 1, Exact, 0);
+    }
+    EXPECT_GT(tt.hashfull(), 0);
+    tt.new_search();
+    EXPECT_EQ(tt.hashfull(), 0);
+}
+
+TEST_F(TtTest, SaveAndLoadKeepsEntries) {
+    auto path = std::filesystem::temp_directory_path() / "tuna_tt_test.bin";
+    auto rng = std::mt19937(0);
+    std::vector<Hash> keys;
+    tt.new_search();
+    for (auto i = 0; i < 1000; i++) {
+        keys.push_back(unique_key(i));
+        tt.store(keys.back(), move_for(keys.back()), score_for(keys.back()),
+                 -score_for(keys.back()), rng() % 64, Exact, 0);
+    }
+    ASSERT_TRUE(tt.save(path));
+    Tt loaded;
+    ASSERT_TRUE(loaded.load(path));
+    EXPECT_EQ(loaded.backing(), FileMapping);
+    EXPECT_EQ(loaded.mb(), 1);
+    EXPECT_EQ(loaded.hashfull(), tt.hashfull());
+    for (auto key : keys) {
+        auto expected = tt.probe(key);
+        auto e = loaded.probe(key);
+        EXPECT_EQ(e.data(), expected.data());
+    }
+    // Stores only modify the private mapping
+    loaded.clear();
+    Tt reloaded;
+    ASSERT_TRUE(reloaded.load(path));
+    EXPECT_EQ(reloaded.probe(keys[0]).data(), tt.probe(keys[0]).data());
+    std::remove(path.c_str());
+}
+
+TEST_F(TtTest, LoadRejectsBadFile) {
+    auto path = std::filesystem::temp_directory_path() / "tuna_tt_bad.bin";
+    ASSERT_TRUE(tt.save(path));
+    // Truncated
+    std::filesystem::resize_file(path, std::filesystem::file_size(path) - 32);
+    EXPECT_FALSE(tt.load(path));
+    // Not a table
+    std::ofstream(path) << "not a transposition table";
+    EXPECT_FALSE(tt.load(path));
+    EXPECT_FALSE(tt.load(path.string() + ".missing"));
+    EXPECT_NE(tt.backing(), FileMapping);
+    std::remove(path.c_str());
+}
+
+// The header is an 8 byte magic, a 64 byte version, then the u64 size and
+// the u8 generation
+TEST_F(TtTest, LoadRejectsBadHeader) {
+    auto path = std::filesystem::temp_directory_path() / "tuna_tt_header.bin";
+    auto save_patched = [&](std::streamoff offset, auto value) {
+        ASSERT_TRUE(tt.save(path));
+        std::fstream file(path,
+                          std::ios::binary | std::ios::in | std::ios::out);
+        file.seekp(offset);
+        file.write(reinterpret_cast<const char *>(&value), sizeof(value));
+    };
+    // Fewer buckets than hashfull samples, in a file of matching size
+    const u64 SMALL_SIZE = 512;
+    save_patched(72, SMALL_SIZE);
+    auto unused_bytes = (tt.mb() * 1024 * 1024 / sizeof(Bucket) - SMALL_SIZE) *
+                        sizeof(Bucket);
+    std::filesystem::resize_file(
+        path, std::filesystem::file_size(path) - unused_bytes);
+    EXPECT_FALSE(tt.load(path));
+    save_patched(80, static_cast<u8>(GENERATION_CYCLE));
+    EXPECT_FALSE(tt.load(path));
+    EXPECT_NE(tt.backing(), FileMapping);
+    std::remove(path.c_str());
+}
+
+TEST_F(TtTest, GrowingKeepsAllEntries) {
+    auto rng = std::mt19937_64(0);
+    std::vector<Hash> keys(10'000);
+    for (auto &key : keys) {
+        key = rng();
+        tt.store(key, move_for(key), score_for(key), 0, 1 + rng() % 20, Exact,
+                 0);
+    }
+    // Only the entries that survived the stores
+    std::vector<std::pair<Hash, u64>> stored;
+    for (auto hash : keys) {
+        auto e = tt.probe(hash);
+        if (e.is_valid()) {
+            stored.emplace_back(hash, e.data());
+        }
+    }
+    // Growing ages the entries, but keeps everything else
+    auto without_generation = [](Entry e) {
+        return e.with_generation(0).data();
+    };
+    tt.resize(4);
+    for (auto [hash, data] : stored) {
+        EXPECT_EQ(without_generation(tt.probe(hash)),
+                  without_generation(Entry::from_data(data)));
+    }
+    // Back to the original size, the duplicates made by growing collapse
+    tt.resize(1);
+    for (auto [hash, data] : stored) {
+        EXPECT_EQ(without_generation(tt.probe(hash)),
+                  without_generation(Entry::from_data(data)));
+    }
+}
+
+// Growing copies each old bucket into several new ones, of which only one
+// is right for its entries. Deep copies must not crowd out new entries.
+TEST_F(TtTest, GrowingLetsNewEntriesReplaceCopies) {
+    auto rng = std::mt19937_64(0);
+    for (auto i = 0; i < 200'000; i++) {
+        tt.store(rng(), move::Null, 0, 0, 30, Exact, 0);
+    }
+    tt.resize(4);
+    // As many keys as the grown table has buckets
+    std::vector<Hash> keys(4 * 32768);
+    for (auto &key : keys) {
+        key = rng();
+        tt.store(key, move::Null, 0, 0, 1, Exact, 0);
+    }
+    u64 found = 0;
+    for (auto key : keys) {
+        found += tt.probe(key).is_valid();
+    }
+    EXPECT_GT(found, keys.size() * 9 / 10);
+}
+
+TEST_F(TtTest, ShrinkingKeepsDeepestEntries) {
+    tt.resize(4);
+    auto rng = std::mt19937_64(0);
+    std::vector<Hash> keys(200'000);
+    for (auto &key : keys) {
+        key = rng();
+        tt.store(key, move::Null, 0, 0, 1 + rng() % 20, Exact, 0);
+    }
+    auto depth_sum = [&](u64 &found) {
+        u64 sum = 0;
+        found = 0;
+        for (auto key : keys) {
+            auto e = tt.probe(key);
+            found += e.is_valid();
+            sum += e.is_valid() ? e.depth() : 0;
+        }
+        return sum;
+    };
+    u64 found_before, found_after;
+    auto sum_before = depth_sum(found_before);
+    tt.resize(1);
+    auto sum_after = depth_sum(found_after);
+    // A 1 MB table has 3 * 32768 slots
+    EXPECT_GT(found_after, 90'000);
+    EXPECT_GT(static_cast<f64>(sum_after) / found_after,
+              static_cast<f64>(sum_before) / found_before);
+}
+
+TEST_F(TtTest, FailedResizeKeepsTable) {
+    auto key = unique_key(1);
+    tt.store(key, move_for(key), score_for(key), 0, 5, Exact, 0);
+    auto data = tt.probe(key).data();
+    // No machine can allocate this
+    EXPECT_THROW(tt.resize(1_u64 << 40), std::bad_alloc);
+    EXPECT_EQ(tt.mb(), 1);
+    EXPECT_EQ(tt.probe(key).data(), data);
+}